@@ -23,7 +23,9 @@
 
 
 
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <sstream>
 #include <algorithm>
 
@@ -37,65 +39,312 @@ constexpr char DATA_LOGTAG[] = "DATA :";
 
 
 
+std::map<const jsl_data*, std::string> jsl_data::m_encodings;
+std::mutex jsl_data::m_encodings_lock;
+const jsl_data::cont_type jsl_data::no_node = nullptr;
+
 jsl_data::~jsl_data()
 {
-	clear();
+	cache(false);
 }
 
-std::string jsl_data::escape(const std::string& _str)
+// Type dispatch, the entry points a bare jsl_data reference can reach
+
+void jsl_data::encode(std::ostream& _out, bool _pretty, std::string _tabs) const
+{
+	if(m_type == TYPE_DICT || m_type == TYPE_VECT)
+	{
+		encode_tree(*this,_out,_pretty,_tabs);
+		return;
+	}
+	((const jsl_data_scal*)this)->write(_out);
+	if(_pretty && _tabs.size() == 0) _out << "\n";
+}
+
+std::string jsl_data::to_string() const
+{
+	if(m_type == TYPE_DICT || m_type == TYPE_VECT)
+	{
+		std::ostringstream out;
+		std::string tabs;
+		encode_tree(*this,out,false,tabs);
+		return out.str();
+	}
+	return ((const jsl_data_scal*)this)->to_string();
+}
+
+void jsl_data::clear()
+{
+	switch(m_type)
+	{
+	case TYPE_DICT:
+		((jsl_data_dict*)this)->clear();
+		break;
+	case TYPE_VECT:
+		((jsl_data_vect*)this)->clear();
+		break;
+	default:
+		((jsl_data_scal*)this)->clear();
+		break;
+	}
+}
+
+void jsl_data::fire()
+{
+	switch(m_type)
+	{
+	case TYPE_DICT:
+		jsl_data_pool::fire(*(jsl_data_dict*)this);
+		break;
+	case TYPE_VECT:
+		jsl_data_pool::fire(*(jsl_data_vect*)this);
+		break;
+	default:
+		jsl_data_pool::fire(*(jsl_data_scal*)this);
+		break;
+	}
+}
+
+void jsl_data::removeChild(const jsl_data& _child)
+{
+	if(m_type == TYPE_DICT) ((jsl_data_dict*)this)->removeChild(_child);
+	else if(m_type == TYPE_VECT) ((jsl_data_vect*)this)->removeChild(_child);
+}
+
+jsl_data* jsl_data::slot_for(int32_t _val)
+{
+	if(_val >= IMM_MIN && _val <= IMM_MAX) return imm(TYPE_INT,_val);
+	return jsl_data_pool::hire(_val);
+}
+
+jsl_data* jsl_data::node_for(const jsl_data* _slot)
+{
+	jsl_data_scal* scal = jsl_data_pool::hire_scal();
+	if(scal == nullptr) return nullptr;
+	scal->load(_slot);
+	return scal;
+}
+
+const jsl_data* jsl_data::peek(const jsl_data* _slot, jsl_data_scal& _scratch)
+{
+	if(is_node(_slot)) return _slot;
+	return &_scratch.load(_slot != nullptr ? _slot : imm(TYPE_NULL));
+}
+
+bool jsl_data::materialize(jsl_data*& _slot, slot_t _handle)
+{
+	if(!is_imm(_slot)) return true;
+	jsl_data* node = node_for(_slot);
+	if(node == nullptr)
+	{
+		ESP_LOGE(DATA_LOGTAG, "Error : materialize, pool empty");
+		return false;
+	}
+	node->m_parent = this;
+	node->m_slot = _handle;
+	node->m_clean = true; // so that touch() goes on to this container
+	_slot = node;
+	return true;
+}
+
+void jsl_data::cache(bool _on)
 {
-	std::string str = "";
-	for(auto i = _str.begin(); i != _str.end(); ++ i)
+	if(_on == m_cached || (_on && m_type != TYPE_DICT && m_type != TYPE_VECT)) return;
 	{
-		switch(*i)
+		std::lock_guard<std::mutex> lock(m_encodings_lock);
+		if(_on) m_encodings[this];
+		else m_encodings.erase(this);
+	}
+	m_cached = _on;
+	if(_on) touch(); // the cache fills on the next encode
+}
+
+void jsl_data::encode_cached(const jsl_data& _node, std::ostream& _out)
+{
+	std::string* encoded;
+	{
+		// map nodes stay put, the string itself is only touched by this tree's encoder
+		std::lock_guard<std::mutex> lock(m_encodings_lock);
+		encoded = &m_encodings[&_node];
+	}
+	if(!_node.m_clean || encoded->empty())
+	{
+		std::ostringstream bytes;
+		std::string tabs;
+		encode_tree(_node,bytes,false,tabs,true); // leaves the subtree clean
+		*encoded = bytes.str();
+	}
+	_out << *encoded;
+}
+
+// Clean runs are found a word at a time (SWAR : 4 bytes on esp32, 8 on hosts)
+// and handed to _write whole, the loop only stops on a byte to escape
+
+template<typename write_t> static void escape_runs(const char* _str, size_t _size, write_t _write)
+{
+	typedef uintptr_t word_t;
+	const word_t ones = ~(word_t)0 / 0xff;
+	const word_t highs = ones * 0x80;
+	static const char hex[] = "0123456789abcdef";
+
+	const char* p = _str;
+	const char* end = _str + _size;
+	while(true)
+	{
+		const char* run = p;
+		word_t w;
+		while((size_t)(end - p) >= sizeof(word_t))
 		{
-		case '\t':
-			str.push_back('\\');
-			str.push_back('t');
-			break;
-		case '\n':
-			str.push_back('\\');
-			str.push_back('n');
-			break;
-		case '\r':
-			str.push_back('\\');
-			str.push_back('r');
-			break;
-		case '\f':
-			str.push_back('\\');
-			str.push_back('f');
-			break;
-		case '\b':
-			str.push_back('\\');
-			str.push_back('b');
-			break;
-		case '\0':
-			str.push_back('\\');
-			str.push_back('0');
-			break;
-		case '\'':
-			str.push_back('\\');
-			str.push_back('\'');
-			break;
-		case '\"':
-			str.push_back('\\');
-			str.push_back('"');
-			break;
-		case '\\':
-			str.push_back('\\');
-			str.push_back('\\');
-			break;
-		// case '/':
-		// 	str.push_back('\\');
-		// 	str.push_back('/');
-		// 	break;
+			std::memcpy(&w,p,sizeof(word_t)); // unaligned load
+			word_t quote = w ^ (ones * '"');
+			word_t slash = w ^ (ones * '\\');
+			if((((quote - ones) & ~quote) | ((slash - ones) & ~slash) | ((w - ones * 0x20) & ~w)) & highs) break;
+			p += sizeof(word_t);
+		}
+		while(p != end && *p != '"' && *p != '\\' && (uint8_t)*p >= 0x20) ++p;
+		if(p != run) _write(run,p - run);
+		if(p == end) return;
+
+		char esc[6] = { '\\' };
+		size_t len = 2;
+		switch(*p)
+		{
+		case '"': esc[1] = '"'; break;
+		case '\\': esc[1] = '\\'; break;
+		case '\t': esc[1] = 't'; break;
+		case '\n': esc[1] = 'n'; break;
+		case '\r': esc[1] = 'r'; break;
+		case '\f': esc[1] = 'f'; break;
+		case '\b': esc[1] = 'b'; break;
 		default:
-			str.push_back(*i);
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = hex[(uint8_t)*p >> 4];
+			esc[5] = hex[*p & 0xf];
+			len = 6;
+			break;
 		}
+		_write(esc,len);
+		++p;
 	}
+}
+
+std::string jsl_data::escape(const std::string& _str)
+{
+	std::string str;
+	str.reserve(_str.size());
+	escape_runs(_str.data(),_str.size(),[&](const char* _run, size_t _len) { str.append(_run,_len); });
 	return str;
 }
 
+void jsl_data::escape(const char* _str, size_t _size, std::ostream& _out)
+{
+	escape_runs(_str,_size,[&](const char* _run, size_t _len) { _out.write(_run,_len); });
+}
+
+void jsl_data::encode_tree(const jsl_data& _root, std::ostream& _out, bool _pretty, std::string& _tabs, bool _capture)
+{
+	// Iterative walk : the containers being written live in stack, not on the call stack
+
+	typedef struct
+	{
+		const jsl_data* node;
+		jsl_data_dict::dict_t::const_iterator prop; // dicts
+		size_t item; // vects
+		bool first;
+	} frame_t;
+
+	std::vector<frame_t> stack;
+	const jsl_data* node = &_root;
+	const bool root = _tabs.empty();
+
+	while(node != nullptr)
+	{
+		// open the node, or write it all when it is a scalar or a cached container
+		if(is_imm(node))
+		{
+			if(imm_type(node) == TYPE_INT) _out << imm_val(node);
+			else if(imm_type(node) == TYPE_BOOL) _out << (imm_val(node) != 0 ? "true" : "false");
+			else _out << "null";
+		}
+		else
+		{
+			if(!_pretty && node->m_cached && !(_capture && node == &_root))
+			{
+				encode_cached(*node,_out);
+			}
+			else switch(node->type())
+			{
+			case TYPE_DICT:
+				_out << '{';
+				if(_pretty) { _tabs += '\t'; _out << '\n'; }
+				stack.push_back({ node, ((const jsl_data_dict*)node)->m_container.begin(), 0, true });
+				break;
+			case TYPE_VECT:
+				_out << '[';
+				if(_pretty) { _tabs += '\t'; _out << '\n'; }
+				stack.push_back({ node, jsl_data_dict::dict_t::const_iterator(), 0, true });
+				break;
+			default:
+				((const jsl_data_scal*)node)->write(_out);
+				break;
+			}
+			node->m_clean = true; // see touch()
+		}
+
+		// find the next node to write, closing the completed containers
+		node = nullptr;
+		while(node == nullptr && !stack.empty())
+		{
+			frame_t& top = stack.back();
+			if(top.node->type() == TYPE_DICT)
+			{
+				const jsl_data_dict::dict_t& props = ((const jsl_data_dict*)top.node)->m_container;
+				if(top.prop != props.end())
+				{
+					if(!top.first) _out << ',' << (_pretty ? "\n" : "");
+					_out << _tabs << '\"';
+					escape(top.prop->first.data(),top.prop->first.size(),_out);
+					_out << "\":" << (_pretty ? " " : "");
+					node = top.prop->second;
+					++top.prop;
+					top.first = false;
+					continue;
+				}
+			}
+			else if(((const jsl_data_vect*)top.node)->m_packed != nullptr)
+			{
+				const jsl_data_vect& vect = *(const jsl_data_vect*)top.node;
+				if(vect.size() > 0) vect.encode_packed(_out,_pretty,_tabs);
+				top.first = vect.size() == 0;
+			}
+			else
+			{
+				const jsl_data_vect::vect_t& items = ((const jsl_data_vect*)top.node)->m_container;
+				if(top.item < items.size())
+				{
+					if(!top.first) _out << ',' << (_pretty ? "\n" : "");
+					_out << _tabs;
+					node = items[top.item++];
+					top.first = false;
+					continue;
+				}
+			}
+
+			if(_pretty)
+			{
+				if(!top.first) _out << '\n';
+				_tabs.pop_back();
+			}
+			_out << _tabs << (top.node->type() == TYPE_DICT ? '}' : ']');
+			stack.pop_back();
+		}
+	}
+
+	if(_pretty && root) _out << '\n';
+}
+
 std::string jsl_data::to_string(bool _val)
 {
 	std::ostringstream s;
@@ -112,9 +361,18 @@ std::string jsl_data::to_string(int32_t _val)
 
 std::string jsl_data::to_string(double _val)
 {
-	std::ostringstream s;
-	s << _val;
-	return s.str();
+	char buf[32];
+	int n = format_real(_val,buf,sizeof(buf));
+	return std::string(buf,n > 0 ? n : 0);
+}
+
+int jsl_data::format_real(double _val, char* _buf, size_t _size)
+{
+	// the shorter of %.15g and %.17g (max_digits10) that parses back to _val,
+	// so whole values up to 15 digits print as ints
+	int n = std::snprintf(_buf,_size,"%.15g",_val);
+	if(n > 0 && (size_t)n < _size && std::strtod(_buf,nullptr) != _val) n = std::snprintf(_buf,_size,"%.17g",_val);
+	return n;
 }
 
 std::string jsl_data::to_string(const std::string& _val)
@@ -129,6 +387,217 @@ std::string jsl_data::to_string(const char* _val)
 
 
 
+jsl_data* jsl_data::clone() const
+{
+	return jsl_data_pool::clone(*this);
+}
+
+uint32_t jsl_data::hash() const
+{
+	if(m_hash != 0) return m_hash;
+
+	// FNV-1a, children before their parent, cached subtrees are not entered
+
+	auto mix = [](uint32_t _hash, const void* _data, size_t _size) -> uint32_t
+	{
+		const uint8_t* p = (const uint8_t*)_data;
+		for(size_t i = 0; i < _size; ++i) _hash = (_hash ^ p[i]) * 16777619u;
+		return _hash;
+	};
+
+	jsl_data_scal value; // immediates hash as the node they stand for
+	auto slot_hash = [&](const jsl_data* _slot) -> uint32_t
+	{
+		if(_slot == nullptr) return 0;
+		return is_imm(_slot) ? value.load(_slot).hash() : _slot->m_hash;
+	};
+	auto real_hash = [&](double _d) -> uint32_t // packed numbers, same as a node
+	{
+		uint8_t tag = TYPE_REAL;
+		if(_d == 0) _d = 0; // -0.0
+		uint32_t hash = mix(mix(2166136261u,&tag,1),&_d,sizeof(_d));
+		return hash != 0 ? hash : 1;
+	};
+
+	std::vector<std::pair<const jsl_data*,bool>> stack(1,{ this, false });
+	while(!stack.empty())
+	{
+		const jsl_data* node = stack.back().first;
+
+		if(!stack.back().second && (node->m_type == TYPE_DICT || node->m_type == TYPE_VECT))
+		{
+			stack.back().second = true;
+			if(node->m_type == TYPE_DICT)
+			{
+				const jsl_data_dict::dict_t& props = ((const jsl_data_dict*)node)->m_container;
+				for(auto prop = props.begin(); prop != props.end(); ++prop)
+				{
+					if(is_node(prop->second) && prop->second->m_hash == 0) stack.push_back({ prop->second, false });
+				}
+			}
+			else
+			{
+				const jsl_data_vect::vect_t& items = ((const jsl_data_vect*)node)->m_container;
+				for(auto item = items.begin(); item != items.end(); ++item)
+				{
+					if(is_node(*item) && (*item)->m_hash == 0) stack.push_back({ *item, false });
+				}
+			}
+			continue;
+		}
+		stack.pop_back();
+
+		uint32_t hash = 2166136261u;
+		uint8_t tag = node->m_type == TYPE_INT ? (uint8_t)TYPE_REAL : (uint8_t)node->m_type;
+		hash = mix(hash,&tag,1);
+
+		switch(node->m_type)
+		{
+		case TYPE_INT:
+		case TYPE_REAL: {
+			double d = (double)*(const jsl_data_scal*)node;
+			if(d == 0) d = 0; // -0.0
+			hash = mix(hash,&d,sizeof(d));
+			break;
+		}
+		case TYPE_BOOL: {
+			uint8_t b = (bool)*(const jsl_data_scal*)node;
+			hash = mix(hash,&b,1);
+			break;
+		}
+		case TYPE_STR: {
+			const jsl_data_scal& scal = *(const jsl_data_scal*)node;
+			hash = mix(hash,scal.str(),scal.length());
+			break;
+		}
+		case TYPE_DICT: {
+			const jsl_data_dict::dict_t& props = ((const jsl_data_dict*)node)->m_container;
+			for(auto prop = props.begin(); prop != props.end(); ++prop)
+			{
+				uint32_t child = slot_hash(prop->second);
+				hash = mix(hash,prop->first.data(),prop->first.size() + 1); // with its terminator
+				hash = mix(hash,&child,sizeof(child));
+			}
+			break;
+		}
+		case TYPE_VECT: {
+			const jsl_data_vect& vect = *(const jsl_data_vect*)node;
+			if(vect.m_packed != nullptr)
+			{
+				for(int32_t i = 0; i < vect.size(); ++i)
+				{
+					double d = 0;
+					vect.get(i,d);
+					uint32_t child = real_hash(d);
+					hash = mix(hash,&child,sizeof(child));
+				}
+				break;
+			}
+			const jsl_data_vect::vect_t& items = vect.m_container;
+			for(auto item = items.begin(); item != items.end(); ++item)
+			{
+				uint32_t child = slot_hash(*item);
+				hash = mix(hash,&child,sizeof(child));
+			}
+			break;
+		}
+		default:
+			break;
+		}
+
+		node->m_hash = hash != 0 ? hash : 1;
+	}
+
+	return m_hash;
+}
+
+bool jsl_data::operator== (const jsl_data& _other) const
+{
+	std::vector<std::pair<const jsl_data*,const jsl_data*>> stack(1,{ this, &_other });
+	jsl_data_scal va, vb; // stand for immediates
+
+	while(!stack.empty())
+	{
+		const jsl_data* a = stack.back().first;
+		const jsl_data* b = stack.back().second;
+		stack.pop_back();
+
+		if(a == b) continue;
+		if(a == nullptr || b == nullptr) return false;
+		if(is_imm(a)) a = &va.load(a);
+		if(is_imm(b)) b = &vb.load(b);
+		if(a->hash() != b->hash()) return false; // cached below the first call
+
+		bool numa = a->m_type == TYPE_INT || a->m_type == TYPE_REAL;
+		bool numb = b->m_type == TYPE_INT || b->m_type == TYPE_REAL;
+		if(numa && numb)
+		{
+			const jsl_data_scal& sa = *(const jsl_data_scal*)a;
+			const jsl_data_scal& sb = *(const jsl_data_scal*)b;
+			if(a->m_type == TYPE_INT && b->m_type == TYPE_INT)
+			{
+				if(sa.m_scal.i != sb.m_scal.i) return false;
+			}
+			else if((double)sa != (double)sb) return false;
+			continue;
+		}
+		if(a->m_type != b->m_type) return false;
+
+		switch(a->m_type)
+		{
+		case TYPE_NULL:
+			break;
+		case TYPE_BOOL:
+			if(((const jsl_data_scal*)a)->m_scal.b != ((const jsl_data_scal*)b)->m_scal.b) return false;
+			break;
+		case TYPE_STR:
+			if(
+				((const jsl_data_scal*)a)->length() != ((const jsl_data_scal*)b)->length() ||
+				std::memcmp(((const jsl_data_scal*)a)->str(),((const jsl_data_scal*)b)->str(),((const jsl_data_scal*)a)->length()) != 0
+			) return false;
+			break;
+		case TYPE_DICT: {
+			const jsl_data_dict::dict_t& pa = ((const jsl_data_dict*)a)->m_container;
+			const jsl_data_dict::dict_t& pb = ((const jsl_data_dict*)b)->m_container;
+			if(pa.size() != pb.size()) return false;
+			for(auto ia = pa.begin(), ib = pb.begin(); ia != pa.end(); ++ia, ++ib)
+			{
+				// both maps are sorted, same size : keys line up or differ
+				if(ia->first != ib->first) return false;
+				stack.push_back({ ia->second, ib->second });
+			}
+			break;
+		}
+		case TYPE_VECT: {
+			const jsl_data_vect& ua = *(const jsl_data_vect*)a;
+			const jsl_data_vect& ub = *(const jsl_data_vect*)b;
+			if(ua.size() != ub.size()) return false;
+			if(ua.m_packed != nullptr || ub.m_packed != nullptr)
+			{
+				// numbers on the packed side, by value on the other
+				for(int32_t i = 0; i < ua.size(); ++i)
+				{
+					double da, db;
+					if(!ua.get(i,da) || !ub.get(i,db) || da != db) return false;
+				}
+				break;
+			}
+			const jsl_data_vect::vect_t& va = ua.m_container;
+			const jsl_data_vect::vect_t& vb = ub.m_container;
+			for(auto ia = va.begin(), ib = vb.begin(); ia != va.end(); ++ia, ++ib)
+			{
+				stack.push_back({ *ia, *ib });
+			}
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
 jsl_data_scal::~jsl_data_scal()
 {
 	clear();
@@ -141,193 +610,841 @@ void jsl_data_scal::clear()
 	m_type = TYPE_NULL;
 	m_scal.i = 0;
 
-	jsl_data::clear();
+	reset();
+}
+
+void jsl_data_scal::fire()
+{
+	jsl_data_pool::fire(*this);
+}
+
+void jsl_data_scal::clearStr()
+{
+	if(m_type == TYPE_STR && m_local == HEAP_STR)
+	{
+		jsl_data_pool::fire_bytes(m_scal.heap.bytes,m_scal.heap.size + 1);
+	}
+	m_local = 0;
+}
+
+jsl_data_scal& jsl_data_scal::assign(const char* _s, size_t _size)
+{
+	touch();
+
+	char* former = m_type == TYPE_STR && m_local == HEAP_STR ? m_scal.heap.bytes : nullptr;
+	size_t former_size = former != nullptr ? m_scal.heap.size : 0;
+
+	char* bytes;
+	if(_size <= INLINE_STR)
+	{
+		bytes = m_scal.local; // overwrites m_scal.heap, former keeps it
+	}
+	else if(former != nullptr && jsl_data_pool::bytes_class(former_size + 1) == jsl_data_pool::bytes_class(_size + 1) && jsl_data_pool::bytes_class(_size + 1) < jsl_data_pool::BYTES_CLASSES)
+	{
+		bytes = former; // same block size, kept
+		former = nullptr;
+	}
+	else
+	{
+		bytes = jsl_data_pool::hire_bytes(_size + 1);
+	}
+
+	std::memmove(bytes,_s,_size); // _s may live in this node
+	bytes[_size] = '\0';
+	if(_size > INLINE_STR)
+	{
+		m_scal.heap.bytes = bytes;
+		m_scal.heap.size = _size;
+		m_local = HEAP_STR;
+	}
+	else
+	{
+		m_local = _size;
+	}
+	if(former != nullptr) jsl_data_pool::fire_bytes(former,former_size + 1);
+
+	m_type = TYPE_STR;
+	return *this;
+}
+
+jsl_data_scal& jsl_data_scal::load(const jsl_data* _slot)
+{
+	touch();
+	clearStr();
+	m_type = imm_type(_slot);
+	if(m_type == TYPE_BOOL) m_scal.b = imm_val(_slot) != 0;
+	else m_scal.i = imm_val(_slot); // 0 for null
+	return *this;
+}
+
+jsl_data_scal& jsl_data_scal::from_string(const char* _str)
+{
+	touch();
+	switch (m_type)
+	{
+	case TYPE_INT: {
+		std::stringstream s(_str);
+		s >> m_scal.i;
+		break;
+	}
+	case TYPE_REAL: { /* -?(?:0|[1-9]\d*)(?:\.\d+)?(?:[eE][+-]?\d+)? */
+		std::stringstream s(_str);
+		s >> m_scal.d;
+		break;
+	}
+	case TYPE_BOOL:
+		m_scal.b = (std::string("true") == _str) || (std::string("TRUE") == _str);
+		break;
+	case TYPE_STR:
+		assign(_str,std::strlen(_str));
+		break;
+	default:; // prevent compiler from complaining about other cases
+	}
+	return *this;
+}
+
+void jsl_data_scal::write(std::ostream& _out) const
+{
+	if(m_type != TYPE_STR)
+	{
+		_out << to_string();
+		return;
+	}
+	_out.put('"');
+	escape(str(),length(),_out);
+	_out.put('"');
+}
+
+std::string jsl_data_scal::to_string() const
+{
+	switch (m_type)
+	{
+	case TYPE_NULL:
+		return "null";
+	case TYPE_INT:
+		return jsl_data::to_string(m_scal.i);
+	case TYPE_REAL:
+		return jsl_data::to_string(m_scal.d);
+	case TYPE_BOOL:
+		return jsl_data::to_string(m_scal.b);
+	case TYPE_STR:
+		return "\"" + escape(std::string(str(),length())) + "\"";
+	default:
+		return "";
+	}
+}
+
+const int32_t jsl_data_scal::empty_int = 0;
+const double jsl_data_scal::empty_double = 0.;
+const bool jsl_data_scal::empty_bool = false;
+const std::string jsl_data_scal::empty_str;
+
+
+
+jsl_data_dict::~jsl_data_dict()
+{
+	// not clear() : the children may be gone already (pool teardown)
+}
+
+void jsl_data_dict::clear()
+{
+	touch();
+	// the children's slot handles point into this container
+	for(auto child = m_container.begin(); child != m_container.end(); ++child)
+	{
+		if(is_node(child->second) && child->second->m_parent == this) child->second->m_parent = nullptr;
+	}
+
+	jsl_data_pool::fire_props(m_container); // map nodes kept for the next puts
+
+	reset();
+}
+
+void jsl_data_dict::fire()
+{
+	jsl_data_pool::fire(*this);
+}
+
+void jsl_data_dict::removeChild(const jsl_data& _child)
+{
+	if(_child.m_slot.key == nullptr) return;
+	auto found = m_container.find(*_child.m_slot.key);
+	if(found != m_container.end() && found->second == &_child)
+	{
+		touch();
+		m_container.erase(found);
+	}
+}
+
+const jsl_data::cont_type& jsl_data_dict::operator[] (const char* _key)
+{
+	auto prop = m_container.try_emplace(_key,nullptr).first;
+	slot_t slot;
+	slot.key = &prop->first;
+	if(!materialize(prop->second,slot)) return no_node;
+	return prop->second;
+}
+
+jsl_data_dict::dict_i jsl_data_dict::find(const char* _key)
+{
+	auto found = m_container.find(_key);
+	if(found == m_container.end()) return found;
+	slot_t slot;
+	slot.key = &found->first;
+	return materialize(found->second,slot) ? found : m_container.end();
+}
+
+jsl_data_dict::dict_i jsl_data_dict::begin()
+{
+	for(auto prop = m_container.begin(); prop != m_container.end(); ++prop)
+	{
+		slot_t slot;
+		slot.key = &prop->first;
+		if(!materialize(prop->second,slot)) return m_container.end();
+	}
+	return m_container.begin();
+}
+
+jsl_data* jsl_data_dict::put(const char* _key, jsl_data* _slot)
+{
+	touch();
+	if(is_node(_slot)) _slot->detach();
+
+	jsl_data* former = nullptr;
+	dict_t::iterator prop;
+	dict_t::node_type kept;
+	if(jsl_data_pool::hire_prop(kept))
+	{
+		// a map node from a fired dict, its key string has room already
+		kept.key() = _key;
+		kept.mapped() = _slot;
+		auto put = m_container.insert(std::move(kept));
+		prop = put.position;
+		if(!put.inserted)
+		{
+			former = prop->second;
+			prop->second = _slot;
+			jsl_data_pool::fire_prop(std::move(put.node));
+		}
+	}
+	else
+	{
+		auto put = m_container.try_emplace(_key,_slot);
+		prop = put.first;
+		if(!put.second)
+		{
+			former = prop->second;
+			prop->second = _slot;
+		}
+	}
+	if(is_node(former)) former->m_parent = nullptr;
+	if(is_node(_slot))
+	{
+		_slot->m_parent = this;
+		_slot->m_slot.key = &prop->first;
+	}
+	return former;
+}
+
+jsl_data* jsl_data_dict::put(dict_t::node_type& _held, jsl_data* _slot)
+{
+	jsl_data* former = _held.mapped();
+	if(former == _slot) former = nullptr; // updated in place
+	else
+	{
+		touch();
+		if(is_node(former)) former->m_parent = nullptr;
+		if(is_node(_slot)) _slot->detach();
+		_held.mapped() = _slot;
+	}
+	auto prop = m_container.insert(std::move(_held)); // no allocation, the key is not there
+	if(is_node(_slot))
+	{
+		_slot->m_parent = this;
+		_slot->m_slot.key = &prop.position->first;
+	}
+	return former;
+}
+
+void jsl_data_dict::settle(dict_t& _spare, bool _keep)
+{
+	if(_spare.empty()) return;
+	if(_keep)
+	{
+		m_container.merge(_spare);
+		return;
+	}
+	touch();
+	for(auto prop = _spare.begin(); prop != _spare.end(); ++prop)
+	{
+		if(!is_node(prop->second)) continue;
+		prop->second->m_parent = nullptr;
+		prop->second->fire();
+	}
+	jsl_data_pool::fire_props(_spare);
+}
+
+jsl_data* jsl_data_dict::set_prop(const char* _key, jsl_data& _item)
+{
+	jsl_data* former = put(_key,&_item);
+	return is_imm(former) ? nullptr : former; // nothing to fire
+}
+
+void jsl_data_dict::set_null(const char* _key)
+{
+	jsl_data* former = put(_key,imm(TYPE_NULL));
+	if(is_node(former)) former->fire();
+}
+
+void jsl_data_dict::set_bool(const char* _key, bool _val)
+{
+	jsl_data* former = put(_key,imm(TYPE_BOOL,_val));
+	if(is_node(former)) former->fire();
+}
+
+bool jsl_data_dict::set_int(const char* _key, int32_t _val)
+{
+	jsl_data* slot = slot_for(_val);
+	if(slot == nullptr) return false;
+	jsl_data* former = put(_key,slot);
+	if(is_node(former)) former->fire();
+	return true;
+}
+
+bool jsl_data_dict::erase(const char* _key)
+{
+	jsl_data* slot = take_slot(_key);
+	if(slot == nullptr) return false;
+	if(!is_imm(slot)) slot->fire();
+	return true;
+}
+
+jsl_data* jsl_data_dict::take_slot(const char* _key)
+{
+	auto found = m_container.find(_key);
+	if(found == m_container.end()) return nullptr;
+	touch();
+	jsl_data* slot = found->second;
+	m_container.erase(found);
+	if(is_node(slot)) slot->m_parent = nullptr;
+	return slot;
+}
+
+jsl_data* jsl_data_dict::take(const char* _key)
+{
+	auto found = find(_key); // materialized
+	if(found == m_container.end()) return nullptr;
+	return take_slot(_key);
+}
+
+bool jsl_data_dict::move(const char* _key, jsl_data_dict& _to, const char* _as)
+{
+	// extract keeps the map node, key string included, no allocation
+	auto prop = m_container.extract(_key);
+	if(prop.empty()) return false;
+	touch();
+	_to.touch();
+	if(_as != nullptr) prop.key() = _as;
+
+	jsl_data* node = prop.mapped();
+	auto found = _to.m_container.find(prop.key());
+	if(found != _to.m_container.end())
+	{
+		if(is_node(found->second))
+		{
+			found->second->m_parent = nullptr;
+			found->second->fire();
+		}
+		found->second = node;
+	}
+	else found = _to.m_container.insert(std::move(prop)).position;
+
+	if(is_node(node))
+	{
+		node->m_parent = &_to;
+		node->m_slot.key = &found->first;
+	}
+	return true;
+}
+
+bool jsl_data_dict::move(const char* _key, jsl_data_vect& _to)
+{
+	if(!_to.unpack()) return false;
+	jsl_data* slot = take_slot(_key);
+	if(slot == nullptr) return false;
+	_to.push_slot(slot);
+	return true;
+}
+
+void jsl_data_dict::splice(jsl_data_dict& _from)
+{
+	if(&_from == this) return;
+	while(!_from.m_container.empty())
+	{
+		_from.move(_from.m_container.begin()->first.c_str(),*this);
+	}
+}
+
+
+
+jsl_data_vect::~jsl_data_vect()
+{
+	// not clear() : the children may be gone already (pool teardown)
+	delete m_packed;
+}
+
+void jsl_data_vect::clear()
+{
+	touch();
+	// the children's slot handles point into this container
+	for(auto child = m_container.begin(); child != m_container.end(); ++child)
+	{
+		if(is_node(*child) && (*child)->m_parent == this) (*child)->m_parent = nullptr;
+	}
+
+	// the room is kept for the next hire, within the pool capacity
+	if(m_container.capacity() > jsl_data_pool::capacity()) vect_t().swap(m_container);
+	else m_container.clear();
+	jsl_data_pool::fire_packed(m_packed);
+	m_packed = nullptr;
+
+	reset();
+}
+
+void jsl_data_vect::fire()
+{
+	jsl_data_pool::fire(*this);
+}
+
+void jsl_data_vect::removeChild(const jsl_data& _child)
+{
+	uint32_t i = _child.m_slot.index;
+	if(i < m_container.size() && m_container[i] == &_child)
+	{
+		touch();
+		m_container.erase(m_container.begin() + i);
+		renumber(i);
+	}
+}
+
+void jsl_data_vect::renumber(size_t _from)
+{
+	for(size_t i = _from; i < m_container.size(); ++i)
+	{
+		if(is_node(m_container[i])) m_container[i]->m_slot.index = i;
+	}
+}
+
+const jsl_data::cont_type& jsl_data_vect::operator[] (int _key)
+{
+	if(!unpack()) return no_node;
+	slot_t slot;
+	slot.index = _key;
+	if(!materialize(m_container[_key],slot)) return no_node;
+	return m_container[_key];
+}
+
+const jsl_data* jsl_data_vect::peek(int32_t _i, jsl_data_scal& _scratch) const
+{
+	if(m_packed == nullptr) return jsl_data::peek(m_container[_i],_scratch);
+	if(m_packed->type == TYPE_INT) _scratch = m_packed->ints[_i];
+	else _scratch = m_packed->reals[_i];
+	return &_scratch;
+}
+
+jsl_data_vect::vect_i jsl_data_vect::begin()
+{
+	if(!unpack()) return m_container.end();
+	for(size_t i = 0; i < m_container.size(); ++i)
+	{
+		slot_t slot;
+		slot.index = i;
+		if(!materialize(m_container[i],slot)) return m_container.end();
+	}
+	return m_container.begin();
 }
 
-void jsl_data_scal::fire()
+void jsl_data_vect::push_back(jsl_data& _item)
 {
-	jsl_data_pool::fire(*this);
+	if(!unpack()) return;
+	touch();
+	_item.detach();
+	_item.m_parent = this;
+	_item.m_slot.index = m_container.size();
+	m_container.push_back(&_item);
 }
 
-jsl_data_scal& jsl_data_scal::from_string(const char* _str)
+bool jsl_data_vect::push_slot(jsl_data* _slot)
 {
-	switch (m_type)
+	if(is_imm(_slot) && imm_type(_slot) == TYPE_INT && (m_packed != nullptr || m_container.empty())) return push_int(imm_val(_slot));
+	if(is_node(_slot))
 	{
-	case TYPE_INT: {
-		std::stringstream s(_str);
-		s >> m_scal.i;
-		break;
-	}
-	case TYPE_REAL: { /* -?(?:0|[1-9]\d*)(?:\.\d+)?(?:[eE][+-]?\d+)? */
-		std::stringstream s(_str);
-		s >> m_scal.d;
-		break;
-	}
-	case TYPE_BOOL:
-		m_scal.b = (std::string("true") == _str) || (std::string("TRUE") == _str);
-		break;
-	case TYPE_STR:
-		m_scal.s = _str;
-		break;
-	default:; // prevent compiler from complaining about other cases
+		if(m_packed != nullptr && !unpack()) return false;
+		push_back(*_slot);
+		return true;
 	}
-	return *this;
+	if(!unpack()) return false;
+	touch();
+	m_container.push_back(_slot);
+	return true;
 }
 
-std::string jsl_data_scal::to_string() const
+void jsl_data_vect::reserve_packed(size_t _size, bool _reals)
 {
-	switch (m_type)
+	if(m_packed != nullptr || !m_container.empty()) return;
+	m_packed = jsl_data_pool::hire_packed(_reals ? TYPE_REAL : TYPE_INT,_size);
+	m_packed->type = TYPE_INT; // still empty, the first real promotes it into the room reserved
+}
+
+bool jsl_data_vect::push_int(int32_t _val)
+{
+	if(m_packed == nullptr && m_container.empty()) m_packed = jsl_data_pool::hire_packed(TYPE_INT);
+	if(m_packed != nullptr)
 	{
-	case TYPE_NULL:
-		return "null";
-	case TYPE_INT:
-		return jsl_data::to_string(m_scal.i);
-	case TYPE_REAL:
-		return jsl_data::to_string(m_scal.d);
-	case TYPE_BOOL:
-		return jsl_data::to_string(m_scal.b);
-	case TYPE_STR:
-		return jsl_data::to_string(m_scal.s);
-	default:
-		return "";
+		touch();
+		if(m_packed->type == TYPE_INT) m_packed->ints.push_back(_val);
+		else m_packed->reals.push_back(_val);
+		return true;
 	}
+	jsl_data* slot = slot_for(_val);
+	if(slot == nullptr) return false;
+	return push_slot(slot);
 }
 
-const int32_t jsl_data_scal::empty_int = 0;
-const double jsl_data_scal::empty_double = 0.;
-const bool jsl_data_scal::empty_bool = false;
-const std::string jsl_data_scal::empty_str;
-
+bool jsl_data_vect::push_real(double _val)
+{
+	if(m_packed == nullptr && m_container.empty()) m_packed = jsl_data_pool::hire_packed(TYPE_REAL);
+	if(m_packed != nullptr)
+	{
+		touch();
+		if(m_packed->type == TYPE_INT)
+		{
+			// promoted, every int is exact as a double
+			m_packed->reals.assign(m_packed->ints.begin(),m_packed->ints.end());
+			std::vector<int32_t>().swap(m_packed->ints);
+			m_packed->type = TYPE_REAL;
+		}
+		m_packed->reals.push_back(_val);
+		return true;
+	}
+	jsl_data* node = jsl_data_pool::hire(_val);
+	if(node == nullptr) return false;
+	push_back(*node);
+	return true;
+}
 
+int32_t jsl_data_vect::lend()
+{
+	if(m_packed == nullptr) return m_container.size();
+	touch();
+	m_packed->ints.clear();
+	m_packed->reals.clear();
+	return 0;
+}
 
-jsl_data_dict::~jsl_data_dict()
+jsl_data* jsl_data_vect::put(int32_t _i, jsl_data* _slot)
 {
-	clear();
+	jsl_data* former = m_container[_i];
+	if(former == _slot) return nullptr; // updated in place
+	touch();
+	if(is_node(former)) former->m_parent = nullptr;
+	if(is_node(_slot))
+	{
+		_slot->detach();
+		_slot->m_parent = this;
+		_slot->m_slot.index = _i;
+	}
+	m_container[_i] = _slot;
+	return former;
 }
 
-void jsl_data_dict::clear()
+void jsl_data_vect::settle(int32_t _met, int32_t _former)
 {
-	m_container.clear(); //erase(m_container.begin(),m_container.end());
+	if(_met < _former) erase(_met,_former - _met); // left unpacked : the caller may hold item nodes
+}
 
-	jsl_data::clear();
+jsl_span<int32_t> jsl_data_vect::ints() const
+{
+	if(m_packed == nullptr || m_packed->type != TYPE_INT) return { nullptr, 0 };
+	return { m_packed->ints.data(), m_packed->ints.size() };
 }
 
-void jsl_data_dict::fire()
+jsl_span<double> jsl_data_vect::reals() const
 {
-	jsl_data_pool::fire(*this);
+	if(m_packed == nullptr || m_packed->type != TYPE_REAL) return { nullptr, 0 };
+	return { m_packed->reals.data(), m_packed->reals.size() };
 }
 
-void jsl_data_dict::removeChild(const jsl_data& _child)
+bool jsl_data_vect::pack()
 {
-	for(auto found = m_container.begin(); found != m_container.end(); ++found)
+	if(m_packed != nullptr) return true;
+
+	node_type_t type = TYPE_INT;
+	for(auto item = m_container.begin(); item != m_container.end(); ++item)
+	{
+		if((*item) == nullptr) return false;
+		node_type_t t = type_of(*item);
+		if(t == TYPE_REAL) type = TYPE_REAL;
+		else if(t != TYPE_INT) return false;
+	}
+
+	packed_t* packed = jsl_data_pool::hire_packed(type,m_container.size());
+	for(auto item = m_container.begin(); item != m_container.end(); ++item)
 	{
-		if(found->second == &_child)
+		if(is_imm(*item))
 		{
-			m_container.erase(found);
-			return;
+			if(type == TYPE_INT) packed->ints.push_back(imm_val(*item));
+			else packed->reals.push_back(imm_val(*item));
+			continue;
 		}
+		if(type == TYPE_INT) packed->ints.push_back((int32_t)*(jsl_data_scal*)*item);
+		else packed->reals.push_back((double)*(jsl_data_scal*)*item);
+		(*item)->m_parent = nullptr;
+		(*item)->fire();
 	}
+	vect_t().swap(m_container);
+	m_packed = packed; // same content, the cached hash holds
+	return true;
 }
 
-void jsl_data_dict::encode(std::ostream& _out, bool _pretty, std::string _tabs) const
+bool jsl_data_vect::unpack()
 {
-	_out << "{";
+	if(m_packed == nullptr) return true;
 
-	char nl = '\0', sp = '\0';
-
-	if(_pretty)
+	vect_t slots;
+	slots.reserve(m_packed->size());
+	for(size_t i = 0; i < m_packed->size(); ++i)
 	{
-		sp = ' ';
-		_tabs += '\t';
-		_out << (nl = '\n');
+		jsl_data* slot = m_packed->type == TYPE_INT ? slot_for(m_packed->ints[i]) : jsl_data_pool::hire(m_packed->reals[i]);
+		if(slot == nullptr)
+		{
+			ESP_LOGE(DATA_LOGTAG, "Error : unpack, pool empty");
+			for(auto item = slots.begin(); item != slots.end(); ++item)
+			{
+				if(is_node(*item)) (*item)->fire();
+			}
+			return false;
+		}
+		if(is_node(slot))
+		{
+			slot->m_parent = this;
+			slot->m_slot.index = i;
+			slot->m_clean = true; // so that touch() goes on to this vect
+		}
+		slots.push_back(slot);
 	}
 
-	for(auto i = m_container.begin(); i != m_container.end(); ++i)
-	{
-		_out << _tabs << '\"' << escape(i->first) << "\":" << sp;
+	m_container.swap(slots);
+	jsl_data_pool::fire_packed(m_packed);
+	m_packed = nullptr;
+	return true;
+}
+
+void jsl_data_vect::encode_packed(std::ostream& _out, bool _pretty, const std::string& _tabs) const
+{
+	// Formatted into a local buffer, one stream write per batch of numbers.
+	// Reals as to_string(double), promoted ints print as ints.
 
-		i->second->encode(_out,_pretty,_tabs);
+	char buf[256];
+	size_t used = 0;
+	const size_t count = m_packed->size();
 
-		if(i != std::prev(m_container.end())) _out << ',';
+	for(size_t i = 0; i < count; ++i)
+	{
+		if(used > sizeof(buf) - 40 || _pretty)
+		{
+			_out.write(buf,used);
+			used = 0;
+		}
+		if(i > 0) buf[used++] = ',';
+		if(_pretty)
+		{
+			if(i > 0) buf[used++] = '\n';
+			_out.write(buf,used);
+			used = 0;
+			_out << _tabs;
+		}
 
-		_out << nl;
+		if(m_packed->type == TYPE_INT)
+		{
+			int32_t v = m_packed->ints[i];
+			uint32_t u = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+			char digits[10];
+			size_t n = 0;
+			do
+			{
+				digits[n++] = '0' + u % 10;
+				u /= 10;
+			} while(u != 0);
+			if(v < 0) buf[used++] = '-';
+			while(n > 0) buf[used++] = digits[--n];
+		}
+		else
+		{
+			int n = format_real(m_packed->reals[i],buf + used,sizeof(buf) - used);
+			if(n > 0) used += n;
+		}
 	}
+	_out.write(buf,used);
+}
 
-	if(_pretty) _tabs.pop_back();
+void jsl_data_vect::insert(int32_t _i, jsl_data& _item)
+{
+	if(!unpack()) return;
+	touch();
+	_item.detach();
+	if(_i < 0) _i = 0;
+	if((size_t)_i > m_container.size()) _i = (int32_t)m_container.size();
+	m_container.insert(m_container.begin() + _i, &_item);
+	_item.m_parent = this;
+	renumber(_i);
+}
 
-	_out << _tabs << "}";
+jsl_data* jsl_data_vect::set(int32_t _i, jsl_data& _item)
+{
+	if(_i < 0 || _i >= size() || !unpack()) return nullptr;
+	jsl_data* former = m_container[_i];
+	if(former == &_item) return nullptr;
+	touch();
+	if(is_node(former)) former->m_parent = nullptr;
+	else if(is_imm(former)) former = nullptr; // nothing to fire
+
+	if(_item.m_parent == this)
+	{
+		// already in here : leave the former slot after taking the new one
+		uint32_t from = _item.m_slot.index;
+		m_container[_i] = &_item;
+		_item.m_slot.index = _i;
+		m_container.erase(m_container.begin() + from);
+		renumber(from < (uint32_t)_i ? from : (uint32_t)_i);
+		return former;
+	}
 
-	if(_pretty && _tabs.size() == 0) _out << nl;
+	_item.detach();
+	m_container[_i] = &_item;
+	_item.m_parent = this;
+	_item.m_slot.index = _i;
+	return former;
 }
 
+void jsl_data_vect::erase(int32_t _first, int32_t _count)
+{
+	if(_first < 0 || _count <= 0 || _first >= size()) return;
+	if(_count > size() - _first) _count = size() - _first;
+	touch();
 
+	if(m_packed != nullptr)
+	{
+		if(m_packed->type == TYPE_INT) m_packed->ints.erase(m_packed->ints.begin() + _first,m_packed->ints.begin() + _first + _count);
+		else m_packed->reals.erase(m_packed->reals.begin() + _first,m_packed->reals.begin() + _first + _count);
+		return;
+	}
 
-jsl_data_vect::~jsl_data_vect()
+	auto first = m_container.begin() + _first;
+	for(auto item = first; item != first + _count; ++item)
+	{
+		if(!is_node(*item)) continue;
+		(*item)->m_parent = nullptr;
+		(*item)->fire();
+	}
+	m_container.erase(first, first + _count);
+	renumber(_first);
+}
+
+jsl_data* jsl_data_vect::take_slot(int32_t _i)
 {
-	clear();
+	if(_i < 0 || _i >= size() || !unpack()) return nullptr;
+	touch();
+	jsl_data* slot = m_container[_i];
+	m_container.erase(m_container.begin() + _i);
+	renumber(_i);
+	if(is_node(slot)) slot->m_parent = nullptr;
+	return slot;
 }
 
-void jsl_data_vect::clear()
+jsl_data* jsl_data_vect::take(int32_t _i)
 {
-	vect_t().swap(m_container);
+	if(_i < 0 || _i >= size() || (*this)[_i] == nullptr) return nullptr; // materialized
+	return take_slot(_i);
+}
 
-	jsl_data::clear();
+bool jsl_data_vect::move(int32_t _i, jsl_data_vect& _to)
+{
+	if(!_to.unpack()) return false;
+	jsl_data* slot = take_slot(_i);
+	if(slot == nullptr) return false;
+	_to.push_slot(slot);
+	return true;
 }
 
-void jsl_data_vect::fire()
+bool jsl_data_vect::move(int32_t _i, jsl_data_dict& _to, const char* _key)
 {
-	jsl_data_pool::fire(*this);
+	jsl_data* slot = take_slot(_i);
+	if(slot == nullptr) return false;
+	jsl_data* former = _to.put(_key,slot);
+	if(is_node(former)) former->fire();
+	return true;
 }
 
-void jsl_data_vect::removeChild(const jsl_data& _child)
+void jsl_data_vect::splice(jsl_data_vect& _from)
 {
-	for(auto found = m_container.begin(); found != m_container.end(); ++found)
+	if(&_from == this) return;
+	if(_from.m_packed != nullptr && (m_packed != nullptr || m_container.empty()))
 	{
-		if(*found == &_child)
+		// numbers onto numbers, no node involved
+		if(_from.m_packed->type == TYPE_INT)
 		{
-			m_container.erase(found);
-			return;
+			for(auto i = _from.m_packed->ints.begin(); i != _from.m_packed->ints.end(); ++i) push_int(*i);
+		}
+		else
+		{
+			for(auto r = _from.m_packed->reals.begin(); r != _from.m_packed->reals.end(); ++r) push_real(*r);
 		}
+		_from.touch();
+		jsl_data_pool::fire_packed(_from.m_packed);
+		_from.m_packed = nullptr;
+		return;
 	}
-}
-
-void jsl_data_vect::encode(std::ostream& _out, bool _pretty, std::string _tabs) const
-{
-	_out << "{";
-
-	char nl = '\0';
-
-	if(_pretty)
+	if(!unpack() || !_from.unpack()) return;
+	touch();
+	m_container.reserve(m_container.size() + _from.m_container.size());
+	for(auto item = _from.m_container.begin(); item != _from.m_container.end(); ++item)
 	{
-		_tabs += '\t';
-		_out << (nl = '\n');
+		if(is_node(*item))
+		{
+			(*item)->m_parent = this;
+			(*item)->m_slot.index = m_container.size();
+		}
+		m_container.push_back(*item);
 	}
+	_from.m_container.clear();
+}
 
-	for(auto i = m_container.begin(); i != m_container.end(); ++i)
-	{
-		_out << _tabs;
 
-		(*i)->encode(_out,_pretty,_tabs);
 
-		if(i != std::prev(m_container.end())) _out << ',';
+void jsl_data_pool::init(uint16_t _s, uint16_t _d, uint16_t _v)
+{
+	ESP_LOGI("DATA :","JSL_DATA_POOL::INIT");
 
-		_out << nl;
+	{
+		// the former scals hand their long strings back to the byte store,
+		// which takes the lock : destroy them before holding it
+		std::vector<jsl_data_scal> scals;
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_scals.swap(scals);
+		}
 	}
 
-	if(_pretty) _tabs.pop_back();
-
-	_out << _tabs << "]";
-
-	if(_pretty && _tabs.size() == 0) _out << nl;
-}
-
+	std::lock_guard<std::mutex> lock(m_lock);
 
+	JSL_STAT(m_stats = jsl_stats());
 
-void jsl_data_pool::init(uint16_t _s, uint16_t _d, uint16_t _v)
-{
-	ESP_LOGI("DATA :","JSL_DATA_POOL::INIT");
+	for(uint8_t c = 0; c < BYTES_CLASSES; ++c)
+	{
+		std::vector<std::unique_ptr<char[]>>().swap(m_bytes_for_hire[c]);
+	}
 
-	std::vector<jsl_data_scal>().swap(m_scals);
 	std::vector<jsl_data_scal*>().swap(m_scals_for_hire);
 	if(_s != 0)
 	{
@@ -353,15 +1470,23 @@ void jsl_data_pool::init(uint16_t _s, uint16_t _d, uint16_t _v)
 	}
 	// ESP_LOGI(DATA_LOGTAG,"Dict pool_init %d => [%d:%d]",_d,m_dicts.size(),m_dicts_for_hire.size());
 
+	std::vector<jsl_data_dict::dict_t::node_type>().swap(m_props_for_hire);
+
 	std::vector<jsl_data_vect>().swap(m_vects);
-	std::vector<jsl_data_vect*>().swap(m_vects_for_hire);
+	for(uint8_t c = 0; c < VECT_CLASSES; ++c)
+	{
+		std::vector<jsl_data_vect*>().swap(m_vects_for_hire[c]);
+		std::vector<std::unique_ptr<jsl_data_vect::packed_t>>().swap(m_packed_for_hire[c]);
+	}
+	m_packed_free = 0;
+	m_vects_free = _v;
 	if(_v != 0)
 	{
 		m_vects.resize(_v);
 		auto v = m_vects.begin();
 		while(v != m_vects.end())
 		{
-			m_vects_for_hire.push_back(&(*v++));
+			m_vects_for_hire[0].push_back(&(*v++));
 		}
 	}
 	// ESP_LOGI(DATA_LOGTAG,"Vect pool_init %d => [%d:%d]",_v,m_vects.size(),m_vects_for_hire.size());
@@ -370,121 +1495,508 @@ void jsl_data_pool::init(uint16_t _s, uint16_t _d, uint16_t _v)
 jsl_data_scal* jsl_data_pool::hire(int32_t _i)
 {
 	jsl_data_scal* data = hire_scal();
-	(*data) = _i;
+	if(data != nullptr) (*data) = _i;
 	return data;
 }
 
 jsl_data_scal* jsl_data_pool::hire(double _d)
 {
 	jsl_data_scal* data = hire_scal();
-	(*data) = _d;
+	if(data != nullptr) (*data) = _d;
 	return data;
 }
 
 jsl_data_scal* jsl_data_pool::hire(bool _b)
 {
 	jsl_data_scal* data = hire_scal();
-	(*data) = _b;
+	if(data != nullptr) (*data) = _b;
 	return data;
 }
 
 jsl_data_scal* jsl_data_pool::hire(const std::string& _s)
 {
 	jsl_data_scal* data = hire_scal();
-	(*data) = _s;
+	if(data != nullptr) (*data) = _s;
 	return data;
 }
 
 jsl_data_scal* jsl_data_pool::hire(const char* _s)
 {
 	jsl_data_scal* data = hire_scal();
-	(*data) = _s;
+	if(data != nullptr) (*data) = _s;
 	return data;
 }
 
 jsl_data_scal* jsl_data_pool::hire_scal()
 {
+	std::lock_guard<std::mutex> lock(m_lock);
 	if(m_scals_for_hire.size() == 0)
 	{
+		JSL_STAT(++m_stats.scal.failed);
 		return nullptr;
 	}
 	jsl_data_scal* data;
 	data = m_scals_for_hire.back();
 	m_scals_for_hire.pop_back();
+	JSL_STAT(count_hire(m_stats.scal,m_scals.size(),m_scals_for_hire.size()));
 	return data;
 }
 
 void jsl_data_pool::fire(jsl_data_scal& _data)
 {
 	_data.clear();
+	_data.cache(false);
+	std::lock_guard<std::mutex> lock(m_lock);
 	if(std::find(m_scals_for_hire.begin(),m_scals_for_hire.end(),&_data) == m_scals_for_hire.end())
 	{
 		m_scals_for_hire.push_back(&_data);
+		JSL_STAT(++m_stats.scal.fired);
+		JSL_STAT(m_stats.scal.used = m_scals.size() - m_scals_for_hire.size());
+	}
+}
+
+uint8_t jsl_data_pool::bytes_class(size_t _size)
+{
+	uint8_t c = 0;
+	while(c < BYTES_CLASSES && ((size_t)1 << (c + BYTES_MIN_SHIFT)) < _size) ++c;
+	return c;
+}
+
+char* jsl_data_pool::hire_bytes(size_t _size)
+{
+	uint8_t c = bytes_class(_size);
+	if(c == BYTES_CLASSES) return new char[_size];
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if(!m_bytes_for_hire[c].empty())
+		{
+			char* bytes = m_bytes_for_hire[c].back().release();
+			m_bytes_for_hire[c].pop_back();
+			return bytes;
+		}
+	}
+	return new char[(size_t)1 << (c + BYTES_MIN_SHIFT)];
+}
+
+void jsl_data_pool::fire_bytes(char* _bytes, size_t _size)
+{
+	uint8_t c = bytes_class(_size);
+	if(c == BYTES_CLASSES)
+	{
+		delete[] _bytes;
+		return;
 	}
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_bytes_for_hire[c].emplace_back(_bytes);
 }
 
 jsl_data_dict* jsl_data_pool::hire_dict()
 {
+	std::lock_guard<std::mutex> lock(m_lock);
 	if(m_dicts_for_hire.size() == 0)
 	{
+		JSL_STAT(++m_stats.dict.failed);
 		return nullptr;
 	}
 	jsl_data_dict* data;
 	data = m_dicts_for_hire.back();
 	m_dicts_for_hire.pop_back();
+	JSL_STAT(count_hire(m_stats.dict,m_dicts.size(),m_dicts_for_hire.size()));
 	return data;
 }
 
 void jsl_data_pool::fire(jsl_data_dict& _data)
 {
-	for(auto child = _data.begin(); child != _data.end(); ++child)
+	fire_tree(_data);
+}
+
+void jsl_data_pool::fire_tree(jsl_data& _root)
+{
+	// Iterative walk, containers left to release are stacked up on the heap
+	std::vector<jsl_data*> stack(1,&_root);
+
+	while(!stack.empty())
 	{
-		if(child->second != nullptr)
+		jsl_data* node = stack.back();
+		stack.pop_back();
+
+		switch(node->type())
 		{
-			child->second->fire();
+		case jsl_data::TYPE_DICT: {
+			jsl_data_dict& dict = *(jsl_data_dict*)node;
+			for(auto child = dict.m_container.begin(); child != dict.m_container.end(); ++child)
+			{
+				if(jsl_data::is_node(child->second)) stack.push_back(child->second);
+			}
+			release(dict);
+			break;
+		}
+		case jsl_data::TYPE_VECT: {
+			jsl_data_vect& vect = *(jsl_data_vect*)node;
+			for(auto child = vect.m_container.begin(); child != vect.m_container.end(); ++child)
+			{
+				if(jsl_data::is_node(*child)) stack.push_back(*child);
+			}
+			release(vect);
+			break;
+		}
+		default:
+			fire(*(jsl_data_scal*)node);
+			break;
 		}
 	}
+}
+
+void jsl_data_pool::release(jsl_data_dict& _data)
+{
 	_data.clear();
+	_data.cache(false);
+	std::lock_guard<std::mutex> lock(m_lock);
 	if(std::find(m_dicts_for_hire.begin(),m_dicts_for_hire.end(),&_data) == m_dicts_for_hire.end())
 	{
 		m_dicts_for_hire.push_back(&_data);
+		JSL_STAT(++m_stats.dict.fired);
+		JSL_STAT(m_stats.dict.used = m_dicts.size() - m_dicts_for_hire.size());
 	}
 }
 
-jsl_data_vect* jsl_data_pool::hire_vect()
+jsl_data_vect* jsl_data_pool::hire_vect(size_t _hint)
 {
-	if(m_vects_for_hire.size() == 0)
+	std::lock_guard<std::mutex> lock(m_lock);
+	jsl_data_vect* data = take_vect(_hint);
+	if(data == nullptr)
 	{
+		JSL_STAT(++m_stats.vect.failed);
 		return nullptr;
 	}
-	jsl_data_vect* data;
-	data = m_vects_for_hire.back();
-	m_vects_for_hire.pop_back();
+	JSL_STAT(count_hire(m_stats.vect,m_vects.size(),m_vects_free));
+	return data;
+}
+
+uint8_t jsl_data_pool::vect_class(size_t _items)
+{
+	// bounds follow capacity(), the room a fired vect keeps at most
+	uint8_t c = 0;
+	while(c + 1 < VECT_CLASSES && ((size_t)m_capacity >> (2 * (VECT_CLASSES - 2 - c))) <= _items) ++c;
+	return c;
+}
+
+jsl_data_vect* jsl_data_pool::take_vect(size_t _hint)
+{
+	if(m_vects_free == 0) return nullptr;
+
+	// the class that fits, or the next larger one, or the largest smaller one
+	uint8_t fit = vect_class(_hint);
+	int8_t c = fit;
+	while(c < VECT_CLASSES && m_vects_for_hire[c].empty()) ++c;
+	if(c == VECT_CLASSES)
+	{
+		c = fit;
+		while(m_vects_for_hire[c].empty()) --c;
+	}
+
+	jsl_data_vect* data = m_vects_for_hire[c].back();
+	m_vects_for_hire[c].pop_back();
+	--m_vects_free;
 	return data;
 }
 
 void jsl_data_pool::fire(jsl_data_vect& _data)
 {
-	for(auto child = _data.begin(); child != _data.end(); ++child)
+	fire_tree(_data);
+}
+
+void jsl_data_pool::release(jsl_data_vect& _data)
+{
+	_data.clear();
+	_data.cache(false);
+	std::lock_guard<std::mutex> lock(m_lock);
+	std::vector<jsl_data_vect*>& vects = m_vects_for_hire[vect_class(_data.m_container.capacity())];
+	if(std::find(vects.begin(),vects.end(),&_data) == vects.end())
+	{
+		vects.push_back(&_data);
+		++m_vects_free;
+		JSL_STAT(++m_stats.vect.fired);
+		JSL_STAT(m_stats.vect.used = m_vects.size() - m_vects_free);
+	}
+}
+
+jsl_data_vect::packed_t* jsl_data_pool::hire_packed(jsl_data::node_type_t _type, size_t _hint)
+{
+	jsl_data_vect::packed_t* packed = nullptr;
 	{
-		if((*child) != nullptr)
+		std::lock_guard<std::mutex> lock(m_lock);
+		if(m_packed_free != 0)
 		{
-			(*child)->fire();
+			// the class that fits, or the next larger one, or the largest smaller one, as take_vect
+			uint8_t fit = vect_class(_hint);
+			int8_t c = fit;
+			while(c < VECT_CLASSES && m_packed_for_hire[c].empty()) ++c;
+			if(c == VECT_CLASSES)
+			{
+				c = fit;
+				while(m_packed_for_hire[c].empty()) --c;
+			}
+			packed = m_packed_for_hire[c].back().release();
+			m_packed_for_hire[c].pop_back();
+			--m_packed_free;
 		}
 	}
-	_data.clear();
-	if(std::find(m_vects_for_hire.begin(),m_vects_for_hire.end(),&_data) == m_vects_for_hire.end())
+	if(packed == nullptr) packed = new jsl_data_vect::packed_t{ _type, {}, {} };
+	packed->type = _type;
+	if(_type == jsl_data::TYPE_INT) packed->ints.reserve(_hint);
+	else packed->reals.reserve(_hint);
+	return packed;
+}
+
+void jsl_data_pool::fire_packed(jsl_data_vect::packed_t* _packed)
+{
+	if(_packed == nullptr) return;
+	size_t room = std::max(_packed->ints.capacity(),_packed->reals.capacity());
+	if(room <= m_capacity && room != 0)
+	{
+		_packed->ints.clear();
+		_packed->reals.clear();
+		std::lock_guard<std::mutex> lock(m_lock);
+		if(m_packed_free < m_vects.size())
+		{
+			m_packed_for_hire[vect_class(room)].emplace_back(_packed);
+			++m_packed_free;
+			return;
+		}
+	}
+	delete _packed;
+}
+
+bool jsl_data_pool::hire_prop(jsl_data_dict::dict_t::node_type& _prop)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if(m_props_for_hire.empty()) return false;
+	_prop = std::move(m_props_for_hire.back());
+	m_props_for_hire.pop_back();
+	return true;
+}
+
+void jsl_data_pool::fire_prop(jsl_data_dict::dict_t::node_type&& _prop)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if(m_props_for_hire.size() < m_dicts.size() * m_capacity) m_props_for_hire.push_back(std::move(_prop));
+}
+
+void jsl_data_pool::fire_props(jsl_data_dict::dict_t& _props)
+{
+	{
+		// a dict keeps up to capacity() map nodes, the pool up to that much per dict
+		std::lock_guard<std::mutex> lock(m_lock);
+		size_t keep = std::min<size_t>(_props.size(),m_capacity);
+		while(keep-- != 0 && m_props_for_hire.size() < m_dicts.size() * m_capacity)
+		{
+			m_props_for_hire.push_back(_props.extract(_props.begin()));
+		}
+	}
+	_props.clear();
+}
+
+jsl_data* jsl_data_pool::clone(const jsl_data& _data)
+{
+	// Count the subtree first so the whole lot is hired at once
+
+	size_t scals = 0, dicts = 0, vects = 0;
+	std::vector<const jsl_data*> stack(1,&_data);
+	while(!stack.empty())
+	{
+		const jsl_data* node = stack.back();
+		stack.pop_back();
+
+		switch(node->type())
+		{
+		case jsl_data::TYPE_DICT: {
+			++dicts;
+			const jsl_data_dict::dict_t& props = ((const jsl_data_dict*)node)->m_container;
+			for(auto child = props.begin(); child != props.end(); ++child)
+			{
+				if(jsl_data::is_node(child->second)) stack.push_back(child->second);
+			}
+			break;
+		}
+		case jsl_data::TYPE_VECT: {
+			++vects;
+			const jsl_data_vect::vect_t& items = ((const jsl_data_vect*)node)->m_container;
+			for(auto child = items.begin(); child != items.end(); ++child)
+			{
+				if(jsl_data::is_node(*child)) stack.push_back(*child);
+			}
+			break;
+		}
+		default:
+			++scals;
+			break;
+		}
+	}
+
+	std::vector<jsl_data_scal*> scal_nodes;
+	std::vector<jsl_data_dict*> dict_nodes;
+	std::vector<jsl_data_vect*> vect_nodes;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if(m_scals_for_hire.size() < scals || m_dicts_for_hire.size() < dicts || m_vects_free < vects)
+		{
+			JSL_STAT(if(m_scals_for_hire.size() < scals) ++m_stats.scal.failed);
+			JSL_STAT(if(m_dicts_for_hire.size() < dicts) ++m_stats.dict.failed);
+			JSL_STAT(if(m_vects_free < vects) ++m_stats.vect.failed);
+			return nullptr;
+		}
+		scal_nodes.assign(m_scals_for_hire.end() - scals, m_scals_for_hire.end());
+		m_scals_for_hire.resize(m_scals_for_hire.size() - scals);
+		dict_nodes.assign(m_dicts_for_hire.end() - dicts, m_dicts_for_hire.end());
+		m_dicts_for_hire.resize(m_dicts_for_hire.size() - dicts);
+		for(size_t v = 0; v < vects; ++v)
+		{
+			vect_nodes.push_back(take_vect(0));
+		}
+		JSL_STAT(if(scals) count_hire(m_stats.scal,m_scals.size(),m_scals_for_hire.size(),scals));
+		JSL_STAT(if(dicts) count_hire(m_stats.dict,m_dicts.size(),m_dicts_for_hire.size(),dicts));
+		JSL_STAT(if(vects) count_hire(m_stats.vect,m_vects.size(),m_vects_free,vects));
+	}
+
+	// Then copy, each source node paired with its hired twin
+
+	auto twin = [&](const jsl_data* _node) -> jsl_data*
+	{
+		switch(_node->type())
+		{
+		case jsl_data::TYPE_DICT: {
+			jsl_data_dict* dict = dict_nodes.back();
+			dict_nodes.pop_back();
+			return dict;
+		}
+		case jsl_data::TYPE_VECT: {
+			jsl_data_vect* vect = vect_nodes.back();
+			vect_nodes.pop_back();
+			const jsl_data_vect& from = *(const jsl_data_vect*)_node;
+			if(from.m_packed != nullptr)
+			{
+				vect->m_packed = hire_packed(from.m_packed->type,from.m_packed->size());
+				vect->m_packed->ints = from.m_packed->ints;
+				vect->m_packed->reals = from.m_packed->reals;
+			}
+			else vect->m_container.reserve(from.m_container.size());
+			return vect;
+		}
+		default: {
+			jsl_data_scal* scal = scal_nodes.back();
+			scal_nodes.pop_back();
+			*scal = *(const jsl_data_scal*)_node;
+			return scal;
+		}
+		}
+	};
+	auto twin_hashed = [&](const jsl_data* _node) -> jsl_data*
+	{
+		jsl_data* node = twin(_node);
+		node->m_hash = _node->m_hash; // same content, the copy starts with the cache
+		return node;
+	};
+
+	jsl_data* root = twin_hashed(&_data);
+	std::vector<std::pair<const jsl_data*,jsl_data*>> pairs(1,{ &_data, root });
+	while(!pairs.empty())
+	{
+		const jsl_data* from = pairs.back().first;
+		jsl_data* to = pairs.back().second;
+		pairs.pop_back();
+
+		if(from->type() == jsl_data::TYPE_DICT)
+		{
+			const jsl_data_dict::dict_t& props = ((const jsl_data_dict*)from)->m_container;
+			jsl_data_dict::dict_t& copy = ((jsl_data_dict*)to)->m_container;
+			for(auto child = props.begin(); child != props.end(); ++child)
+			{
+				if(child->second == nullptr) continue;
+				if(jsl_data::is_imm(child->second))
+				{
+					copy.emplace_hint(copy.end(),child->first,child->second); // the slot is the value
+					continue;
+				}
+				jsl_data* node = twin_hashed(child->second);
+				node->m_parent = to;
+				node->m_slot.key = &copy.emplace_hint(copy.end(),child->first,node)->first; // source order, constant time
+				if(node->type() == jsl_data::TYPE_DICT || node->type() == jsl_data::TYPE_VECT) pairs.push_back({ child->second, node });
+			}
+		}
+		else if(from->type() == jsl_data::TYPE_VECT)
+		{
+			const jsl_data_vect::vect_t& items = ((const jsl_data_vect*)from)->m_container;
+			jsl_data_vect::vect_t& copy = ((jsl_data_vect*)to)->m_container;
+			for(auto child = items.begin(); child != items.end(); ++child)
+			{
+				if((*child) == nullptr) continue;
+				if(jsl_data::is_imm(*child))
+				{
+					copy.push_back(*child);
+					continue;
+				}
+				jsl_data* node = twin_hashed(*child);
+				node->m_parent = to;
+				node->m_slot.index = copy.size();
+				copy.push_back(node);
+				if(node->type() == jsl_data::TYPE_DICT || node->type() == jsl_data::TYPE_VECT) pairs.push_back({ *child, node });
+			}
+		}
+	}
+
+	return root;
+}
+
+jsl_stats jsl_data_pool::stats()
+{
+	jsl_stats stats = {};
+#if JSL_STATS
+	std::lock_guard<std::mutex> lock(m_lock);
+	stats.scal = m_stats.scal;
+	stats.dict = m_stats.dict;
+	stats.vect = m_stats.vect;
+#endif
+	return stats;
+}
+
+void jsl_data_pool::reset_stats()
+{
+#if JSL_STATS
+	std::lock_guard<std::mutex> lock(m_lock);
+	jsl_stats::pool_t* pools[] = { &m_stats.scal, &m_stats.dict, &m_stats.vect };
+	for(auto p : pools)
 	{
-		m_vects_for_hire.push_back(&_data);
+		// keep what is still hired as the new baseline
+		*p = { 0, 0, p->used, p->used, 0 };
 	}
+#endif
 }
 
+#if JSL_STATS
+void jsl_data_pool::count_hire(jsl_stats::pool_t& _stats, size_t _total, size_t _for_hire, size_t _count)
+{
+	_stats.hired += _count;
+	_stats.used = _total - _for_hire;
+	if(_stats.used > _stats.high) _stats.high = _stats.used;
+}
+
+jsl_stats jsl_data_pool::m_stats = {};
+#endif
+
+std::mutex	jsl_data_pool::m_lock;
+std::vector<std::unique_ptr<char[]>>	jsl_data_pool::m_bytes_for_hire[BYTES_CLASSES]; // before the nodes : outlives them
 std::vector<jsl_data_scal>	jsl_data_pool::m_scals;
 std::vector<jsl_data_scal*>	jsl_data_pool::m_scals_for_hire;
 std::vector<jsl_data_dict>	jsl_data_pool::m_dicts;
 std::vector<jsl_data_dict*>	jsl_data_pool::m_dicts_for_hire;
 std::vector<jsl_data_vect>	jsl_data_pool::m_vects;
-std::vector<jsl_data_vect*>	jsl_data_pool::m_vects_for_hire;
+std::vector<jsl_data_vect*>	jsl_data_pool::m_vects_for_hire[VECT_CLASSES];
+size_t	jsl_data_pool::m_vects_free = 0;
+uint32_t	jsl_data_pool::m_capacity = 64;
+std::vector<std::unique_ptr<jsl_data_vect::packed_t>>	jsl_data_pool::m_packed_for_hire[VECT_CLASSES];
+size_t	jsl_data_pool::m_packed_free = 0;
+std::vector<jsl_data_dict::dict_t::node_type>	jsl_data_pool::m_props_for_hire;
 
 /*
 
@@ -27,18 +27,75 @@
 #ifndef JSL_DATA_H
 #define JSL_DATA_H
 
+#include <cstring>
+#include <ostream>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
 
+// Instrumentation counters, compiled out unless JSL_STATS is defined non zero
+
+#ifndef JSL_STATS
+#define JSL_STATS 0
+#endif
+
+#if JSL_STATS
+#define JSL_STAT(_stmt) _stmt
+#else
+#define JSL_STAT(_stmt)
+#endif
+
+struct jsl_stats
+{
+	typedef struct
+	{
+		uint32_t hired;
+		uint32_t fired;
+		uint32_t used; // currently hired
+		uint32_t high; // high-water mark of used
+		uint32_t failed; // hires refused, pool exhausted
+	} pool_t;
+
+	pool_t scal;
+	pool_t dict;
+	pool_t vect;
+
+	uint64_t parsed_bytes; // source bytes consumed by parse calls
+	uint64_t copied_bytes; // string values and keys copied into the tree
+
+	uint64_t parse_us; // whole parse calls, the structure cost is what the phases below leave
+	uint64_t num_us; // eat_num
+	uint64_t str_us; // eat_str
+	uint64_t lit_us; // eat_null, eat_true, eat_false
+};
+
+class jsl_data_scal;
 class jsl_data_dict;
 class jsl_data_vect;
 
+// Read only view over contiguous values (see jsl_data_vect::ints)
+
+template<typename T> struct jsl_span
+{
+	const T* data;
+	size_t size;
+
+	inline const T* begin() const { return data; }
+	inline const T* end() const { return data + size; }
+	inline const T& operator[] (size_t _i) const { return data[_i]; }
+};
+
+// No virtual member : the node type tag drives every dispatch, so nodes carry
+// no vtable pointer and the calls below the generic entry points can inline.
+// Only jsl_data_scal, jsl_data_dict and jsl_data_vect are ever instantiated.
+
 class jsl_data
 {
 public :
 
-	typedef enum {
+	typedef enum : uint8_t {
 		TYPE_NULL,
 		TYPE_INT,
 		TYPE_REAL,
@@ -48,11 +105,6 @@ public :
 		TYPE_VECT
 	} node_type_t;
 
-	jsl_data() :
-		m_type(TYPE_NULL),
-		m_parent(nullptr)
-	{}
-
 	inline operator node_type_t () const { return m_type; }
 	inline node_type_t type() const { return m_type; }
 
@@ -62,52 +114,179 @@ public :
 	{
 		if(m_parent != nullptr && m_parent != &_parent)
 		{
-			m_parent->removeChild(*this);
+			detach();
 		}
 		m_parent = &_parent;
 	}
 
-	virtual void encode(std::ostream& _out, bool _pretty = false, std::string _tabs = "") const
+	// Leaves the parent container (through the slot handle, no scan)
+	void detach()
 	{
-		_out << "null";
+		if(m_parent != nullptr)
+		{
+			m_parent->removeChild(*this);
+			m_parent = nullptr;
+		}
 	}
 
-	virtual ~jsl_data();
+	void encode(std::ostream& _out, bool _pretty = false, std::string _tabs = "") const;
 
-	virtual std::string to_string() const { return "null"; };
+	std::string to_string() const; // compact encoding
 
 	static std::string to_string(bool _val);
 	static std::string to_string(int32_t _val);
 	static std::string to_string(double _val);
+	static int format_real(double _val, char* _buf, size_t _size); // as snprintf, parses back to _val exactly
 	static std::string to_string(const std::string& _val);
 	static std::string to_string(const char* _val);
 
-	inline virtual void clear() { m_parent = nullptr; }
-	inline virtual void fire() {}
+	void clear();
+	void fire(); // back to the pool, subtree included
 
+	// Content hash, computed on demand then cached until the subtree changes.
+	// Numbers hash by value (1 and 1.0 match). Not safe against concurrent
+	// mutation of the same tree.
+	uint32_t hash() const;
+
+	// Keeps the compact encoding of this container from one encode to the next,
+	// for the subtrees of a resident tree that rarely change. Encoding then
+	// only walks the changed paths and copies the cached bytes for the rest.
+	// Pretty encoding doesn't use it. Dropped when the node goes back to the pool.
+	void cache(bool _on);
+	inline bool cached() const { return m_cached; }
+
+	// Deep equality, short-circuits on hash mismatch
+	bool operator== (const jsl_data& _other) const;
+	bool operator!= (const jsl_data& _other) const { return !(*this == _other); }
+
+	// Deep copy hired from the pool, nullptr when the pool can't hold it all
+	jsl_data* clone() const;
+
+	// JSON string escaping, quotes not included : \" \\ \t \n \r \f \b and
+	// \u00XX for the other control chars, every other byte as it is
 	static std::string escape(const std::string& _str);
+	static void escape(const char* _str, size_t _size, std::ostream& _out); // clean runs in one write
 
 protected :
 
+	static void encode_tree(const jsl_data& _root, std::ostream& _out, bool _pretty, std::string& _tabs, bool _capture = false);
+
 	friend class jsl_data_pool;
+	friend class jsl_data_dict; // moves reparent nodes directly
+	friend class jsl_data_vect;
+	friend class jsl_parser; // stores immediates
+	friend class jsl_image; // reads the slots as they are
+	friend class jsl_patch; // so do the diffs and merges
 
 	jsl_data(node_type_t _type) :
+		m_parent(nullptr),
+		m_slot(),
+		m_hash(0),
 		m_type(_type),
-		m_parent(nullptr)
+		m_clean(false),
+		m_cached(false)
 	{}
 
 	jsl_data(node_type_t _type, jsl_data& _parent) :
+		m_parent(&_parent),
+		m_slot(),
+		m_hash(0),
 		m_type(_type),
-		m_parent(&_parent)
+		m_clean(false),
+		m_cached(false)
+	{}
+
+	// Copies are detached and uncached
+	jsl_data(const jsl_data& _data) :
+		m_parent(nullptr),
+		m_slot(),
+		m_hash(0),
+		m_type(_data.m_type),
+		m_clean(false),
+		m_cached(false)
 	{}
 
-	virtual void removeChild(const jsl_data& _child) {} // does nothing
+	jsl_data& operator= (const jsl_data& _data)
+	{
+		touch();
+		m_type = _data.m_type;
+		return *this;
+	}
+
+	// Not virtual : nodes are only destroyed through their own type (pool)
+	~jsl_data();
+
+	void reset() { m_parent = nullptr; touch(); } // the base part of clear()
+
+	// Marks this node and its ancestors dirty : drops their cached hash and
+	// invalidates their cached encoding. A node that is neither hashed nor clean
+	// only has dirty ancestors, so the walk stops at the first one
+	inline void touch()
+	{
+		for(jsl_data* node = this; node != nullptr && (node->m_hash != 0 || node->m_clean); node = node->m_parent)
+		{
+			node->m_hash = 0;
+			node->m_clean = false;
+		}
+	}
+
+	static void encode_cached(const jsl_data& _node, std::ostream& _out);
+
+
+	void removeChild(const jsl_data& _child); // to the container type
 
-	node_type_t m_type;
 	jsl_data* m_parent;
 
+	// Where this node sits in m_parent, kept up to date by the containers
+	union slot_t
+	{
+		const std::string* key; // dict : key of the map node (stable until erased)
+		uint32_t index; // vect
+		slot_t() : key(nullptr) {}
+	} m_slot;
+
+	mutable uint32_t m_hash; // 0 : not computed
+
+	// byte fields last, a jsl_data_scal packs its own into the tail padding
+	node_type_t m_type;
+	mutable bool m_clean; // unchanged since an encode walked it
+	bool m_cached; // has an entry in m_encodings, see cache()
+
+	// Compact encoding caches, off the nodes : few containers ever use one
+	static std::map<const jsl_data*, std::string> m_encodings;
+	static std::mutex m_encodings_lock;
+
+	// Immediate values : null, bools and small ints held in the container slot
+	// itself as a tagged pointer (low bit set, nodes are word aligned), no node
+	// is hired for them. The readers (get, encode, hash, ==, clone) take them as
+	// they are, handing a node out (operator[], find, begin, take) materializes
+	// them from the pool first. A slot is imm | type << 1 | value << IMM_SHIFT.
+
+	enum {
+		IMM_SHIFT = 3
+	};
+	static constexpr int32_t IMM_MIN = -(1 << 28); // fits a 32-bit pointer
+	static constexpr int32_t IMM_MAX = (1 << 28) - 1;
+
+	static inline bool is_imm(const jsl_data* _slot) { return ((uintptr_t)_slot & 1) != 0; }
+	static inline bool is_node(const jsl_data* _slot) { return _slot != nullptr && !is_imm(_slot); }
+	static inline jsl_data* imm(node_type_t _type, int32_t _val = 0) // TYPE_NULL, TYPE_INT or TYPE_BOOL
+	{
+		return (jsl_data*)(((uintptr_t)(intptr_t)_val << IMM_SHIFT) | ((uintptr_t)_type << 1) | 1);
+	}
+	static inline node_type_t imm_type(const jsl_data* _slot) { return (node_type_t)(((uintptr_t)_slot >> 1) & 3); }
+	static inline int32_t imm_val(const jsl_data* _slot) { return (int32_t)((intptr_t)_slot >> IMM_SHIFT); }
+	static inline node_type_t type_of(const jsl_data* _slot) { return is_imm(_slot) ? imm_type(_slot) : _slot->m_type; }
+
+	static jsl_data* slot_for(int32_t _val); // an immediate, a hired node out of range (nullptr when the pool is empty)
+	static jsl_data* node_for(const jsl_data* _slot); // a detached node holding the value, nullptr when the pool is empty
+	static const jsl_data* peek(const jsl_data* _slot, jsl_data_scal& _scratch); // the node, or _scratch loaded with the immediate (null for an empty slot)
+	bool materialize(jsl_data*& _slot, slot_t _handle); // in place, false when the pool is empty
+
 	typedef jsl_data* cont_type;
 
+	const static cont_type no_node; // handed out when a materialization fails
+
 };
 
 
@@ -116,93 +295,131 @@ class jsl_data_scal : public jsl_data
 {
 public:
 
+	enum {
+		INLINE_STR = 15 // longest string held in the node itself, longer ones go to the pool byte store
+	};
+
 	jsl_data_scal() :
 		jsl_data(TYPE_NULL),
+		m_local(0),
 		m_scal(0)
 	{
 	}
 
 	jsl_data_scal(const jsl_data_scal& _scal) :
-		jsl_data(_scal.m_type)
+		jsl_data(TYPE_NULL),
+		m_local(0),
+		m_scal(0)
 	{
-		switch (m_type)
-		{
-			case TYPE_INT:
-				m_scal.i = _scal.m_scal.i;
-				break;
-			case TYPE_REAL:
-				m_scal.d = _scal.m_scal.d;
-				break;
-			case TYPE_BOOL:
-				m_scal.b = _scal.m_scal.b;
-				break;
-			case TYPE_STR:
-				new (&m_scal.s) std::string(_scal.m_scal.s);
-				break;
-			default:
-				break;
-		}
+		*this = _scal;
 	}
 
 	jsl_data_scal(int32_t _i) :
 		jsl_data(TYPE_INT),
+		m_local(0),
 		m_scal(_i)
 	{
 	}
 	jsl_data_scal(double _d) :
 		jsl_data(TYPE_REAL),
+		m_local(0),
 		m_scal(_d)
 	{
 	}
 	jsl_data_scal(bool _b) :
 		jsl_data(TYPE_BOOL),
+		m_local(0),
 		m_scal(_b)
 	{
 	}
 	jsl_data_scal(const std::string& _s) :
-		jsl_data(TYPE_STR),
-		m_scal(_s)
+		jsl_data(TYPE_NULL),
+		m_local(0),
+		m_scal(0)
 	{
+		assign(_s.data(),_s.size());
 	}
 	jsl_data_scal(const char* _s) :
-		jsl_data(TYPE_STR),
-		m_scal(_s)
+		jsl_data(TYPE_NULL),
+		m_local(0),
+		m_scal(0)
 	{
+		assign(_s,std::strlen(_s));
 	}
 
 	jsl_data_scal(int32_t _i, jsl_data& _parent) :
 		jsl_data(TYPE_INT, _parent),
+		m_local(0),
 		m_scal(_i)
 	{
 	}
 	jsl_data_scal(double _d, jsl_data& _parent) :
 		jsl_data(TYPE_REAL, _parent),
+		m_local(0),
 		m_scal(_d)
 	{
 	}
 	jsl_data_scal(bool _b, jsl_data& _parent) :
 		jsl_data(TYPE_BOOL, _parent),
+		m_local(0),
 		m_scal(_b)
 	{
 	}
 	jsl_data_scal(const std::string& _s, jsl_data& _parent) :
-		jsl_data(TYPE_STR, _parent),
-		m_scal(_s)
+		jsl_data(TYPE_NULL, _parent),
+		m_local(0),
+		m_scal(0)
 	{
+		assign(_s.data(),_s.size());
 	}
 	jsl_data_scal(const char* _s, jsl_data& _parent) :
-		jsl_data(TYPE_STR, _parent),
-		m_scal(_s)
+		jsl_data(TYPE_NULL, _parent),
+		m_local(0),
+		m_scal(0)
 	{
+		assign(_s,std::strlen(_s));
 	}
 
-	virtual ~jsl_data_scal();
+	~jsl_data_scal();
+
+	void clear();
+	void fire();
+
+	// Copies the value, not the parent
+	jsl_data_scal& operator= (const jsl_data_scal& _scal)
+	{
+		if(&_scal == this) return *this;
+		touch();
+		clearStr();
+		m_type = _scal.m_type;
+		switch (m_type)
+		{
+			case TYPE_INT:
+				m_scal.i = _scal.m_scal.i;
+				break;
+			case TYPE_REAL:
+				m_scal.d = _scal.m_scal.d;
+				break;
+			case TYPE_BOOL:
+				m_scal.b = _scal.m_scal.b;
+				break;
+			case TYPE_STR:
+				m_type = TYPE_NULL; // cleared above
+				assign(_scal.str(),_scal.length());
+				break;
+			default:
+				m_scal.i = 0;
+				break;
+		}
+		return *this;
+	}
 
-	inline virtual void clear();
-	inline virtual void fire();
+	using jsl_data::operator==;
+	using jsl_data::operator!=;
 
 	jsl_data_scal& operator= (int32_t _i)
 	{
+		touch();
 		clearStr();
 		m_type = TYPE_INT;
 		m_scal = _i;
@@ -210,6 +427,7 @@ public:
 	}
 	jsl_data_scal& operator= (double _d)
 	{
+		touch();
 		clearStr();
 		m_type = TYPE_REAL;
 		m_scal = _d;
@@ -217,6 +435,7 @@ public:
 	}
 	jsl_data_scal& operator= (bool _b)
 	{
+		touch();
 		clearStr();
 		m_type = TYPE_BOOL;
 		m_scal = _b;
@@ -224,18 +443,23 @@ public:
 	}
 	jsl_data_scal& operator= (const std::string& _s)
 	{
-		clearStr();
-		m_type = TYPE_STR;
-		m_scal = _s;
-		return *this;
+		return assign(_s.data(),_s.size());
 	}
 	jsl_data_scal& operator= (const char* _s)
 	{
-		clearStr();
-		m_type = TYPE_STR;
-		m_scal = _s;
-		return *this;
+		return assign(_s,std::strlen(_s));
+	}
+
+	// Any byte may be part of the string (\u0000 included), _s may point into this node
+	jsl_data_scal& assign(const char* _s, size_t _size);
+
+	// The string in place, NUL terminated (empty when not a string)
+	inline const char* str() const
+	{
+		if(m_type != TYPE_STR) return empty_str.c_str();
+		return m_local == HEAP_STR ? m_scal.heap.bytes : m_scal.local;
 	}
+	inline uint32_t str_size() const { return m_type == TYPE_STR ? length() : 0; }
 
 	bool operator== (int32_t _i) const
 	{
@@ -251,11 +475,11 @@ public:
 	}
 	bool operator== (const std::string& _s) const
 	{
-		return m_type == TYPE_STR && m_scal.s == _s;
+		return m_type == TYPE_STR && length() == _s.size() && std::memcmp(str(),_s.data(),_s.size()) == 0;
 	}
 	bool operator== (const char* _s) const
 	{
-		return m_type == TYPE_STR && m_scal.s == std::string(_s);
+		return m_type == TYPE_STR && length() == std::strlen(_s) && std::memcmp(str(),_s,length()) == 0;
 	}
 
 	operator int32_t() const
@@ -277,13 +501,12 @@ public:
 	}
 	operator std::string () const
 	{
-		if(m_type == TYPE_STR) return m_scal.s;
+		if(m_type == TYPE_STR) return std::string(str(),length());
 		return empty_str;
 	}
 	operator const char* () const
 	{
-		if(m_type == TYPE_STR) return m_scal.s.c_str();
-		return empty_str.c_str();
+		return str();
 	}
 
 	jsl_data_scal& from_string(const std::string& _str)
@@ -292,59 +515,48 @@ public:
 	}
 	jsl_data_scal& from_string(const char* _str);
 
-	virtual std::string to_string() const;
-
-	virtual void encode(std::ostream& _out, bool _pretty = false, std::string _tabs = "") const
-	{
-		_out << to_string();
-		if(_pretty && _tabs.size() == 0) _out << "\n";
-	}
+	std::string to_string() const;
+	void write(std::ostream& _out) const; // to_string() straight into _out, no copy
 
 protected:
 
+	enum {
+		HEAP_STR = 0xff // m_local of a string held in m_scal.heap
+	};
+
+	uint8_t m_local; // length of an inline string, sits in the tail padding of jsl_data
+
 	union scalar
 	{
 		int32_t i;
 		double d;
 		bool b;
-		std::string s;
+		struct
+		{
+			char* bytes; // a byte store block sized for size + 1
+			uint32_t size;
+		} heap; // strings over INLINE_STR
+		char local[INLINE_STR + 1]; // shorter strings, NUL terminated
 
 		scalar(){}
 
 		scalar(int32_t _i) : i(_i) {}
 		scalar(double _d) : d(_d) {}
 		scalar(bool _b) : b(_b) {}
-		scalar(const std::string& _s)
-		{
-			new (&s) std::string(_s);
-		}
-		scalar(const char* _s)
-		{
-			new (&s) std::string(_s);
-		}
 
 		scalar& operator= (int32_t _i) { i = _i; return *this; }
 		scalar& operator= (double _d) { d = _d; return *this; }
 		scalar& operator= (bool _b) { b = _b; return *this; }
-		scalar& operator= (const char* _s)
-		{
-			new (&s) std::string(_s); return *this;
-		}
-		scalar& operator= (const std::string& _s)
-		{
-			new (&s) std::string(_s); return *this;
-		}
-
-		~scalar(){}
 	} m_scal;
 
-	void clearStr()
-	{
-		if(m_type == TYPE_STR)
-		{
-			m_scal.s.std::string::~string();
-		}
-	}
+	inline uint32_t length() const { return m_local == HEAP_STR ? m_scal.heap.size : m_local; }
+
+	jsl_data_scal& load(const jsl_data* _slot); // the value of an immediate
+
+	void clearStr(); // hands a long string back to the byte store
+
+	friend class jsl_data; // hash and equality read the value in place
+	friend class jsl_data_vect;
 
 	const static int32_t empty_int;
 	const static double empty_double;
@@ -358,49 +570,61 @@ class jsl_data_dict : public jsl_data
 {
 public:
 
-	jsl_data_dict()
+	jsl_data_dict() :
+		jsl_data(TYPE_DICT)
 	{
-		m_type = TYPE_DICT;
 	}
 
 	typedef std::map<std::string, cont_type> dict_t;
 	typedef dict_t::iterator dict_i;
 
+	// Accessing a prop hands its node out : an immediate is materialized
+	// first, no_node (nullptr) when the pool can't
+
 	const cont_type& operator[] (const dict_t::key_type& _key)
 	{
-		return m_container[_key];
-	}
-	const cont_type& operator[] (const char* _key)
-	{
-		return m_container[_key];
+		return operator[](_key.c_str());
 	}
+	const cont_type& operator[] (const char* _key);
 
 	dict_i find(const dict_t::key_type& _key) { return find(_key.c_str()); }
-	inline dict_i find(const char* _key) { return m_container.find(_key); }
+	dict_i find(const char* _key); // end() as well when materializing fails
 
  	inline int32_t size() { return m_container.size(); }
-	inline dict_i begin() { return m_container.begin(); }
+	dict_i begin(); // materializes every prop, end() when the pool can't (size it for it)
 	inline dict_i end() { return m_container.end(); }
 
-	void set_prop(const dict_t::key_type& _key, jsl_data& _item)
-	{
-		set_prop(_key.c_str(),_item);
-	}
-	void set_prop(const char* _key, jsl_data& _item)
+	// Returns the node formerly held under _key (detached, not fired) or nullptr
+	jsl_data* set_prop(const dict_t::key_type& _key, jsl_data& _item)
 	{
-		m_container[_key] = &_item;
-		_item.setParent(*this);
+		return set_prop(_key.c_str(),_item);
 	}
+	jsl_data* set_prop(const char* _key, jsl_data& _item);
+
+	// Stored in the slot (no node) when the value allows it, false when the pool is empty
+	void set_null(const char* _key);
+	void set_bool(const char* _key, bool _val);
+	bool set_int(const char* _key, int32_t _val);
+
+	bool erase(const char* _key); // fires the prop, false when not found
+
+	// Moving transfers the node itself (no copy, no pool traffic) and
+	// fires whatever prop of the same name the destination already had
+
+	jsl_data* take(const char* _key); // detached, nullptr when not found
+	bool move(const char* _key, jsl_data_dict& _to, const char* _as = nullptr); // _as : new key
+	bool move(const char* _key, jsl_data_vect& _to); // appended
+	void splice(jsl_data_dict& _from); // every prop of _from, which is left empty
 
 	bool get(const char* _name, int32_t& _val) const
 	{
 		auto f = m_container.find(_name);
 		if(
 			f != m_container.end() && (
-			f->second->type() == TYPE_REAL ||
-			f->second->type() == TYPE_INT
+			type_of(f->second) == TYPE_REAL ||
+			type_of(f->second) == TYPE_INT
 		)){
-			_val = (int32_t)*((jsl_data_scal*)f->second);
+			_val = is_imm(f->second) ? imm_val(f->second) : (int32_t)*((jsl_data_scal*)f->second);
 			return true;
 		}
 		return false;
@@ -411,10 +635,10 @@ public:
 		auto f = m_container.find(_name);
 		if(
 			f != m_container.end() && (
-			f->second->type() == TYPE_INT ||
-			f->second->type() == TYPE_REAL
+			type_of(f->second) == TYPE_INT ||
+			type_of(f->second) == TYPE_REAL
 		)){
-			_val = (double)*((jsl_data_scal*)f->second);
+			_val = is_imm(f->second) ? imm_val(f->second) : (double)*((jsl_data_scal*)f->second);
 			return true;
 		}
 		return false;
@@ -425,9 +649,9 @@ public:
 		auto f = m_container.find(_name);
 		if(
 			f != m_container.end() &&
-			f->second->type() == TYPE_BOOL
+			type_of(f->second) == TYPE_BOOL
 		){
-			_val = (bool)*((jsl_data_scal*)f->second);
+			_val = is_imm(f->second) ? imm_val(f->second) != 0 : (bool)*((jsl_data_scal*)f->second);
 			return true;
 		}
 		return false;
@@ -438,7 +662,7 @@ public:
 		auto f = m_container.find(_name);
 		if(
 			f != m_container.end() &&
-			f->second->type() == TYPE_STR
+			type_of(f->second) == TYPE_STR
 		){
 			_val = (const std::string&)*((jsl_data_scal*)f->second);
 			return true;
@@ -452,7 +676,7 @@ public:
 		auto f = m_container.find(_name);
 		if(
 			f != m_container.end() &&
-			f->second->type() == TYPE_DICT
+			type_of(f->second) == TYPE_DICT
 		){
 			_val = (jsl_data_dict*)f->second;
 			return true;
@@ -466,7 +690,7 @@ public:
 		auto f = m_container.find(_name);
 		if(
 			f != m_container.end() &&
-			f->second->type() == TYPE_VECT
+			type_of(f->second) == TYPE_VECT
 		){
 			_val = (jsl_data_vect*)f->second;
 			return true;
@@ -474,18 +698,33 @@ public:
 		return false;
 	}
 
-	virtual ~jsl_data_dict();
-
-	virtual void encode(std::ostream& _out, bool _pretty = false, std::string _tabs = "") const;
+	~jsl_data_dict();
 
-	virtual void clear();
-	virtual void fire();
+	void clear();
+	void fire();
 
 protected:
 
+	friend class jsl_data;
+	friend class jsl_data_vect; // moves raw slots
+	friend class jsl_data_pool;
+	friend class jsl_parser;
+	friend class jsl_image;
+	friend class jsl_patch;
+
 	dict_t m_container;
 
-	virtual void removeChild(const jsl_data& _child);
+	// Raw slots, immediates included
+	jsl_data* put(const char* _key, jsl_data* _slot); // returns the former slot, detached
+	jsl_data* take_slot(const char* _key);
+
+	// Reparse (see jsl_parser::reparse) : the props are lent to _spare while the
+	// source is read, the ones met again are put back with their map node
+	inline void lend(dict_t& _spare) { m_container.swap(_spare); }
+	jsl_data* put(dict_t::node_type& _held, jsl_data* _slot); // former slot when it changed, nullptr otherwise
+	void settle(dict_t& _spare, bool _keep); // props left in _spare are fired, or kept
+
+	void removeChild(const jsl_data& _child);
 };
 
 
@@ -494,37 +733,76 @@ class jsl_data_vect : public jsl_data
 {
 public:
 
-	jsl_data_vect()
+	jsl_data_vect() :
+		jsl_data(TYPE_VECT),
+		m_packed(nullptr)
 	{
-		m_type = TYPE_VECT;
 	}
 
 	typedef std::vector<cont_type> vect_t;
 	typedef vect_t::iterator vect_i;
 
-	const cont_type& operator[] (int _key)
-	{
-		return m_container[_key];
-	}
+	// Accessing an item hands its node out : an immediate is materialized
+	// first, no_node (nullptr) when the pool can't
+	const cont_type& operator[] (int _key);
 
-	inline int32_t size() { return m_container.size(); }
-	inline vect_i begin() { return m_container.begin(); }
+	inline int32_t size() const { return m_packed != nullptr ? m_packed->size() : m_container.size(); }
+	vect_i begin(); // materializes every item, end() when the pool can't (size it for it)
 	inline vect_i end() { return m_container.end(); }
 
-	void push_back(jsl_data& _item)
-	{
-		m_container.push_back(&_item);
-		_item.setParent(*this);
-	}
+	inline void reserve(int32_t _size) { m_container.reserve(_size); }
+
+	// Packed mode : a vect that has only ever held numbers keeps them in one
+	// contiguous array (int32_t, double once a real shows up) instead of a
+	// slot and a node per item. The parser and push_int / push_real pick it
+	// on their own, get, encode, hash, == and clone read the array in place,
+	// anything handing out a node or storing another kind of value unpacks
+	// the vect first (reals take a node each, size the pool for it).
+
+	inline bool packed() const { return m_packed != nullptr; }
+	jsl_span<int32_t> ints() const; // empty unless packed ints
+	jsl_span<double> reals() const; // empty unless packed reals
+
+	bool pack(); // false when an item is not a number
+	bool unpack(); // false when the pool is empty
+
+	void push_back(jsl_data& _item); // left detached when unpacking fails
+
+	// Stored in the slot (no node) when the value allows it, false when the pool is empty
+	inline bool push_null() { return push_slot(imm(TYPE_NULL)); }
+	inline bool push_bool(bool _val) { return push_slot(imm(TYPE_BOOL,_val)); }
+	bool push_int(int32_t _val);
+	bool push_real(double _val);
+
+	void insert(int32_t _i, jsl_data& _item); // clamped to [0,size]
+
+	// Returns the node formerly at _i (detached, not fired), nullptr when out of range
+	jsl_data* set(int32_t _i, jsl_data& _item);
+
+	// Erasing fires the items, one shift and one renumbering pass per call
+	void erase(int32_t _first, int32_t _count = 1);
+	template<typename pred_t> int32_t erase_if(pred_t _pred); // _pred(jsl_data&), returns the count erased
+
+	// Moving transfers the node itself (no copy, no pool traffic)
+
+	jsl_data* take(int32_t _i); // detached, nullptr when out of range
+	bool move(int32_t _i, jsl_data_vect& _to); // appended
+	bool move(int32_t _i, jsl_data_dict& _to, const char* _key);
+	void splice(jsl_data_vect& _from); // appends every item of _from, which is left empty
 
 	bool get(int32_t _i, int32_t& _val) const
 	{
+		if(m_packed != nullptr && _i >= 0 && (size_t)_i < m_packed->size())
+		{
+			_val = m_packed->type == TYPE_INT ? m_packed->ints[_i] : (int32_t)(m_packed->reals[_i] + 0.5);
+			return true;
+		}
 		if(
-			_i >= 0 && _i < m_container.size() && (
-			m_container[_i]->type() == TYPE_REAL ||
-			m_container[_i]->type() == TYPE_INT
+			_i >= 0 && (size_t)_i < m_container.size() && (
+			type_of(m_container[_i]) == TYPE_REAL ||
+			type_of(m_container[_i]) == TYPE_INT
 		)){
-			_val = (int32_t)*((jsl_data_scal*)m_container[_i]);
+			_val = is_imm(m_container[_i]) ? imm_val(m_container[_i]) : (int32_t)*((jsl_data_scal*)m_container[_i]);
 			return true;
 		}
 		return false;
@@ -532,12 +810,17 @@ public:
 
 	bool get(int32_t _i, double& _val) const
 	{
+		if(m_packed != nullptr && _i >= 0 && (size_t)_i < m_packed->size())
+		{
+			_val = m_packed->type == TYPE_INT ? m_packed->ints[_i] : m_packed->reals[_i];
+			return true;
+		}
 		if(
-			_i >= 0 && _i < m_container.size() && (
-			m_container[_i]->type() == TYPE_INT ||
-			m_container[_i]->type() == TYPE_REAL
+			_i >= 0 && (size_t)_i < m_container.size() && (
+			type_of(m_container[_i]) == TYPE_INT ||
+			type_of(m_container[_i]) == TYPE_REAL
 		)){
-			_val = (double)*((jsl_data_scal*)m_container[_i]);
+			_val = is_imm(m_container[_i]) ? imm_val(m_container[_i]) : (double)*((jsl_data_scal*)m_container[_i]);
 			return true;
 		}
 		return false;
@@ -546,10 +829,10 @@ public:
 	bool get(int32_t _i, bool& _val) const
 	{
 		if(
-			_i >= 0 && _i < m_container.size() &&
-			m_container[_i]->type() == TYPE_BOOL
+			_i >= 0 && (size_t)_i < m_container.size() &&
+			type_of(m_container[_i]) == TYPE_BOOL
 		){
-			_val = (bool)*((jsl_data_scal*)m_container[_i]);
+			_val = is_imm(m_container[_i]) ? imm_val(m_container[_i]) != 0 : (bool)*((jsl_data_scal*)m_container[_i]);
 			return true;
 		}
 		return false;
@@ -558,8 +841,8 @@ public:
 	bool get(int32_t _i, std::string& _val) const
 	{
 		if(
-			_i >= 0 && _i < m_container.size() &&
-			m_container[_i]->type() == TYPE_STR
+			_i >= 0 && (size_t)_i < m_container.size() &&
+			type_of(m_container[_i]) == TYPE_STR
 		){
 			_val = (const std::string&)*((jsl_data_scal*)m_container[_i]);
 			return true;
@@ -571,8 +854,8 @@ public:
 	{
 		_val = nullptr;
 		if(
-			_i >= 0 && _i < m_container.size() &&
-			m_container[_i]->type() == TYPE_DICT
+			_i >= 0 && (size_t)_i < m_container.size() &&
+			type_of(m_container[_i]) == TYPE_DICT
 		){
 			_val = (jsl_data_dict*)m_container[_i];
 			return true;
@@ -584,8 +867,8 @@ public:
 	{
 		_val = nullptr;
 		if(
-			_i >= 0 && _i < m_container.size() &&
-			m_container[_i]->type() == TYPE_VECT
+			_i >= 0 && (size_t)_i < m_container.size() &&
+			type_of(m_container[_i]) == TYPE_VECT
 		){
 			_val = (jsl_data_vect*)m_container[_i];
 			return true;
@@ -593,30 +876,108 @@ public:
 		return false;
 	}
 
-	virtual ~jsl_data_vect();
-
-	virtual void encode(std::ostream& _out, bool _pretty = false, std::string _tabs = "") const;
+	~jsl_data_vect();
 
-	virtual void clear();
-	virtual void fire();
+	void clear();
+	void fire();
 
 protected:
 
+	friend class jsl_data;
+	friend class jsl_data_dict; // moves raw slots
+	friend class jsl_data_pool;
+	friend class jsl_parser;
+	friend class jsl_image;
+	friend class jsl_patch;
+
 	vect_t m_container;
 
-	virtual void removeChild(const jsl_data& _child);
+	struct packed_t
+	{
+		node_type_t type; // TYPE_INT or TYPE_REAL
+		std::vector<int32_t> ints;
+		std::vector<double> reals;
+
+		inline size_t size() const { return type == TYPE_INT ? ints.size() : reals.size(); }
+	} *m_packed; // numbers only, m_container is then empty
+
+	void encode_packed(std::ostream& _out, bool _pretty, const std::string& _tabs) const;
+
+	bool push_slot(jsl_data* _slot); // raw slot, immediates included, false when unpacking fails
+	void reserve_packed(size_t _size, bool _reals); // packed room taken ahead (ints until a real shows up), an empty vect only
+	const jsl_data* peek(int32_t _i, jsl_data_scal& _scratch) const; // item _i in place : the node, or _scratch loaded with an immediate or a packed number
+	jsl_data* take_slot(int32_t _i);
+
+	// Reparse (see jsl_parser::reparse) : former items are overwritten in
+	// place, a packed vect is refilled and keeps its arrays and element type,
+	// an unpacked one keeps its item nodes
+	int32_t lend(); // count of former items to overwrite
+	jsl_data* put(int32_t _i, jsl_data* _slot); // former slot when it changed, nullptr otherwise
+	void settle(int32_t _met, int32_t _former); // fires the former items not met
+
+	void renumber(size_t _from); // slot handles from _from on
+
+	void removeChild(const jsl_data& _child);
 };
 
+template<typename pred_t> int32_t jsl_data_vect::erase_if(pred_t _pred)
+{
+	// Single compaction pass, immediates and packed numbers are shown through a stack node
+	touch();
+	jsl_data_scal value;
+	size_t kept = 0;
+	if(m_packed != nullptr)
+	{
+		for(size_t i = 0; i < m_packed->size(); ++i)
+		{
+			if(m_packed->type == TYPE_INT) value = m_packed->ints[i];
+			else value = m_packed->reals[i];
+			if(_pred((jsl_data&)value)) continue;
+			if(m_packed->type == TYPE_INT) m_packed->ints[kept++] = m_packed->ints[i];
+			else m_packed->reals[kept++] = m_packed->reals[i];
+		}
+		int32_t erased = m_packed->size() - kept;
+		m_packed->ints.resize(m_packed->type == TYPE_INT ? kept : 0);
+		m_packed->reals.resize(m_packed->type == TYPE_REAL ? kept : 0);
+		return erased;
+	}
+	for(size_t i = 0; i < m_container.size(); ++i)
+	{
+		jsl_data* item = m_container[i];
+		if(is_imm(item) && _pred((jsl_data&)value.load(item))) continue;
+		if(is_node(item) && _pred(*item))
+		{
+			item->m_parent = nullptr;
+			item->fire();
+			continue;
+		}
+		if(is_node(item)) item->m_slot.index = kept;
+		m_container[kept++] = item;
+	}
+	int32_t erased = m_container.size() - kept;
+	m_container.resize(kept);
+	return erased;
+}
+
 class jsl_data_pool
 {
 public:
 
 	enum {
-		STORE_STEP = 2
+		STORE_STEP = 2,
+		BYTES_MIN_SHIFT = 5, // 32 bytes blocks
+		BYTES_CLASSES = 8, // up to 4K
+		VECT_CLASSES = 4 // vects and packed arrays for hire by capacity : under capacity() / 16, / 4, capacity() and at capacity()
 	};
 
 	static void init(uint16_t _s, uint16_t _d, uint16_t _v);
 
+	// Room a container keeps when it goes back to the pool : vect capacity,
+	// packed arrays and dict map nodes (key strings included) up to this many
+	// items, larger ones are trimmed. The next hires refill it without
+	// reallocating. Defaults to 64, 0 gives everything back to the heap.
+	static inline uint32_t& capacity() { return m_capacity; }
+
 	static jsl_data_scal* hire(int32_t _i);
 	static jsl_data_scal* hire(double _d);
 	static jsl_data_scal* hire(bool _b);
@@ -625,14 +986,44 @@ public:
 
 	static jsl_data_scal* hire_scal();
 	static jsl_data_dict* hire_dict();
-	static jsl_data_vect* hire_vect();
+	static jsl_data_vect* hire_vect(size_t _hint = 0); // _hint : expected items, a vect that has the room is picked
+
+	// Byte store for the strings too long to sit in their node : power of two
+	// blocks, recycled through one free list per size class (larger ones
+	// come from the heap). _size is the one given to hire_bytes
+	static char* hire_bytes(size_t _size);
+	static void fire_bytes(char* _bytes, size_t _size);
+	static uint8_t bytes_class(size_t _size); // BYTES_CLASSES : not recycled
 
 	static void fire(jsl_data_scal& _data);
 	static void fire(jsl_data_dict& _data);
 	static void fire(jsl_data_vect& _data);
 
+	// Deep copy : the whole subtree is counted, hired in one go then copied,
+	// nullptr (and nothing hired) when the pool can't hold it all
+	static jsl_data* clone(const jsl_data& _data);
+	static jsl_data_scal* clone(const jsl_data_scal& _data) { return (jsl_data_scal*)clone((const jsl_data&)_data); }
+	static jsl_data_dict* clone(const jsl_data_dict& _data) { return (jsl_data_dict*)clone((const jsl_data&)_data); }
+	static jsl_data_vect* clone(const jsl_data_vect& _data) { return (jsl_data_vect*)clone((const jsl_data&)_data); }
+
+	// Pool part of the counters (parser fields left to zero), see jsl_parser::stats()
+	static jsl_stats stats();
+	static void reset_stats();
+
 protected:
 
+	friend class jsl_data_dict; // recycled storage
+	friend class jsl_data_vect;
+
+	static void fire_tree(jsl_data& _root);
+	static void release(jsl_data_dict& _data); // the node alone, not its children
+	static void release(jsl_data_vect& _data);
+
+	// hire and fire may be called from several parser threads (see jsl_parser::parse_vect)
+	static std::mutex m_lock;
+
+	static std::vector<std::unique_ptr<char[]>>	m_bytes_for_hire[BYTES_CLASSES];
+
 	static std::vector<jsl_data_scal>	m_scals;
 	static std::vector<jsl_data_scal*>	m_scals_for_hire;
 
@@ -640,7 +1031,28 @@ protected:
 	static std::vector<jsl_data_dict*>	m_dicts_for_hire;
 
 	static std::vector<jsl_data_vect>	m_vects;
-	static std::vector<jsl_data_vect*>	m_vects_for_hire;
+	static std::vector<jsl_data_vect*>	m_vects_for_hire[VECT_CLASSES];
+	static size_t m_vects_free;
+
+	static uint8_t vect_class(size_t _items);
+	static jsl_data_vect* take_vect(size_t _hint); // m_lock held, nullptr when none is left
+
+	// Storage kept by the containers fired, see capacity()
+	static uint32_t m_capacity;
+	static std::vector<std::unique_ptr<jsl_data_vect::packed_t>> m_packed_for_hire[VECT_CLASSES];
+	static size_t m_packed_free;
+	static std::vector<jsl_data_dict::dict_t::node_type> m_props_for_hire;
+
+	static jsl_data_vect::packed_t* hire_packed(jsl_data::node_type_t _type, size_t _hint = 0); // _hint : expected numbers
+	static void fire_packed(jsl_data_vect::packed_t* _packed);
+	static bool hire_prop(jsl_data_dict::dict_t::node_type& _prop); // false when none is kept
+	static void fire_prop(jsl_data_dict::dict_t::node_type&& _prop);
+	static void fire_props(jsl_data_dict::dict_t& _props); // left empty
+
+#if JSL_STATS
+	static void count_hire(jsl_stats::pool_t& _stats, size_t _total, size_t _for_hire, size_t _count = 1);
+	static jsl_stats m_stats;
+#endif
 };
 
 
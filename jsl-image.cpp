@@ -0,0 +1,496 @@
+/*
+	jsl-image.cpp
+
+	This scource file is part of the jsl-esp32 project.
+
+	Author: Lorenzo Pastrana
+	Copyright © 2019 Lorenzo Pastrana
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your
+	option) any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+	for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#define LOG_LOCAL_LEVEL ESP_LOG_NONE
+// #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+constexpr char IMAGE_LOGTAG[] = "IMAGE :";
+#include <esp_log.h>
+
+#include "jsl-image.h"
+
+
+
+static const char image_magic[4] = { 'J', 'S', 'L', 'I' };
+
+bool jsl_image::build(const jsl_data& _root, std::string& _image)
+{
+	// Iterative walk as encode_tree : a container record is laid out with room
+	// for its refs when it is met, its children are appended after it and their
+	// refs filled in as they are written
+
+	typedef struct
+	{
+		const jsl_data* node;
+		jsl_data_dict::dict_t::const_iterator prop; // dicts
+		size_t item; // vects
+		uint32_t slot; // next ref to fill in
+	} frame_t;
+
+	const size_t base = _image.size();
+	std::vector<frame_t> stack;
+	std::unordered_map<std::string, uint32_t> strs; // offsets of the strings written so far
+
+	auto here = [&]() -> uint32_t { return (uint32_t)(_image.size() - base); };
+	auto put = [&](uint32_t _word)
+	{
+		for(int b = 0; b < 4; ++b) _image.push_back((char)(_word >> (b * 8)));
+	};
+	auto set = [&](uint32_t _off, uint32_t _word)
+	{
+		for(int b = 0; b < 4; ++b) _image[base + _off + b] = (char)(_word >> (b * 8));
+	};
+	auto put_real = [&](double _val)
+	{
+		uint64_t bits;
+		std::memcpy(&bits,&_val,sizeof(bits));
+		put((uint32_t)bits);
+		put((uint32_t)(bits >> 32));
+	};
+	auto put_str = [&](const char* _str, uint32_t _len) -> uint32_t
+	{
+		std::string key(_str,_len);
+		auto f = strs.find(key);
+		if(f != strs.end()) return f->second;
+
+		const uint32_t off = here();
+		put(_len);
+		_image.append(_str,_len);
+		_image.append(4 - (_len & 3),'\0'); // NUL and padding
+		strs.emplace(std::move(key),off);
+		return off;
+	};
+
+	// ref of a value, containers get their record and a frame
+	auto value = [&](const jsl_data* _slot) -> uint32_t
+	{
+		if(jsl_data::is_imm(_slot))
+		{
+			return ref(jsl_data::imm_type(_slot),(uint32_t)jsl_data::imm_val(_slot)); // same range
+		}
+
+		const jsl_data_scal& scal = *(const jsl_data_scal*)_slot; // containers don't read it
+		const uint32_t off = here();
+		switch(_slot->type())
+		{
+		case jsl_data::TYPE_INT:
+		{
+			const int32_t val = scal;
+			if(val >= jsl_data::IMM_MIN && val <= jsl_data::IMM_MAX) return ref(jsl_data::TYPE_INT,(uint32_t)val);
+			put((uint32_t)val);
+			return ref(TAG_INT32,off);
+		}
+		case jsl_data::TYPE_REAL:
+			put_real(scal);
+			return ref(jsl_data::TYPE_REAL,off);
+		case jsl_data::TYPE_BOOL:
+			return ref(jsl_data::TYPE_BOOL,(bool)scal ? 1 : 0);
+		case jsl_data::TYPE_STR:
+			return ref(jsl_data::TYPE_STR,put_str(scal.str(),scal.str_size()));
+		case jsl_data::TYPE_DICT:
+		{
+			const jsl_data_dict::dict_t& props = ((const jsl_data_dict*)_slot)->m_container;
+			put(props.size());
+			stack.push_back({ _slot, props.begin(), 0, here() });
+			_image.append(props.size() * 8,'\0');
+			return ref(jsl_data::TYPE_DICT,off);
+		}
+		case jsl_data::TYPE_VECT:
+		{
+			const jsl_data_vect& vect = *(const jsl_data_vect*)_slot;
+			if(vect.m_packed != nullptr)
+			{
+				if(vect.m_packed->type == jsl_data::TYPE_INT)
+				{
+					put(vect.m_packed->ints.size() | LAYOUT_INTS << LAYOUT_SHIFT);
+					for(int32_t v : vect.m_packed->ints) put((uint32_t)v);
+				}
+				else
+				{
+					put(vect.m_packed->reals.size() | LAYOUT_REALS << LAYOUT_SHIFT);
+					for(double v : vect.m_packed->reals) put_real(v);
+				}
+				return ref(jsl_data::TYPE_VECT,off);
+			}
+			put(vect.m_container.size());
+			stack.push_back({ _slot, jsl_data_dict::dict_t::const_iterator(), 0, here() });
+			_image.append(vect.m_container.size() * 4,'\0');
+			return ref(jsl_data::TYPE_VECT,off);
+		}
+		default:
+			return ref(jsl_data::TYPE_NULL,0);
+		}
+	};
+
+	_image.append(image_magic,sizeof(image_magic));
+	put(VERSION);
+	put(0); // size, once known
+	put(0); // root
+	set(12,value(&_root));
+
+	while(!stack.empty())
+	{
+		frame_t& top = stack.back();
+		const jsl_data* child = nullptr;
+		uint32_t slot = top.slot;
+
+		if(top.node->type() == jsl_data::TYPE_DICT)
+		{
+			if(top.prop == ((const jsl_data_dict*)top.node)->m_container.end())
+			{
+				stack.pop_back();
+				continue;
+			}
+			set(slot,put_str(top.prop->first.data(),top.prop->first.size()));
+			child = top.prop->second;
+			++top.prop;
+			slot += 4;
+			top.slot += 8;
+		}
+		else
+		{
+			const jsl_data_vect::vect_t& items = ((const jsl_data_vect*)top.node)->m_container;
+			if(top.item == items.size())
+			{
+				stack.pop_back();
+				continue;
+			}
+			child = items[top.item++];
+			top.slot += 4;
+		}
+
+		const uint32_t val = value(child); // may push, top is stale from here
+		set(slot,val);
+	}
+
+	if(_image.size() - base > PAYLOAD_MASK)
+	{
+		ESP_LOGE(IMAGE_LOGTAG, "Error : build, image too large");
+		_image.resize(base);
+		return false;
+	}
+	set(8,here());
+	return true;
+}
+
+jsl_view jsl_image::open(const void* _image, size_t _size)
+{
+	const uint8_t* base = (const uint8_t*)_image;
+	if(base == nullptr || _size < HEADER_SIZE || std::memcmp(base,image_magic,sizeof(image_magic)) != 0)
+	{
+		ESP_LOGE(IMAGE_LOGTAG, "Error : open, not an image");
+		return jsl_view();
+	}
+
+	const jsl_view header(base,HEADER_SIZE,0);
+	const uint32_t size = header.word(8);
+	if(header.word(4) != VERSION || size < HEADER_SIZE || size > _size) // a big endian reader sees another version
+	{
+		ESP_LOGE(IMAGE_LOGTAG, "Error : open, bad header");
+		return jsl_view();
+	}
+	return jsl_view(base,size,header.word(12));
+}
+
+
+
+jsl_data::node_type_t jsl_view::type() const
+{
+	if(!valid()) return jsl_data::TYPE_NULL;
+	if(tag() == jsl_image::TAG_INT32) return jsl_data::TYPE_INT;
+	return tag() <= jsl_data::TYPE_VECT ? (jsl_data::node_type_t)tag() : jsl_data::TYPE_NULL;
+}
+
+int32_t jsl_view::size() const
+{
+	uint32_t count, layout;
+	return items(count,layout) ? count : 0;
+}
+
+jsl_view jsl_view::operator[] (const char* _name) const
+{
+	return find(_name,std::strlen(_name));
+}
+
+jsl_view jsl_view::find(const char* _name, size_t _len) const
+{
+	uint32_t count, layout;
+	if(tag() != jsl_data::TYPE_DICT || !items(count,layout)) return jsl_view();
+
+	// same order as the dict_t keys : bytes compared unsigned, then lengths
+	const uint32_t first = payload() + 4;
+	uint32_t lo = 0, hi = count;
+	while(lo < hi)
+	{
+		const uint32_t mid = lo + (hi - lo) / 2;
+		uint32_t len;
+		const char* key = text(word(first + mid * 8),len);
+		if(key == nullptr) return jsl_view();
+
+		int cmp = std::memcmp(key,_name,std::min<size_t>(len,_len));
+		if(cmp == 0) cmp = len < _len ? -1 : len > _len ? 1 : 0;
+		if(cmp == 0) return child(word(first + mid * 8 + 4));
+		if(cmp < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	return jsl_view();
+}
+
+jsl_view jsl_view::operator[] (int32_t _i) const
+{
+	uint32_t count, layout;
+	if(!items(count,layout) || _i < 0 || (uint32_t)_i >= count) return jsl_view();
+
+	const uint32_t first = payload() + 4;
+	if(tag() == jsl_data::TYPE_DICT) return child(word(first + _i * 8 + 4));
+
+	switch(layout)
+	{
+	case jsl_image::LAYOUT_INTS:
+		return jsl_view(m_base,m_size,jsl_image::ref(jsl_image::TAG_INT32,first + _i * 4));
+	case jsl_image::LAYOUT_REALS:
+		return jsl_view(m_base,m_size,jsl_image::ref(jsl_data::TYPE_REAL,first + _i * 8));
+	default:
+		return child(word(first + _i * 4));
+	}
+}
+
+const char* jsl_view::name(int32_t _i) const
+{
+	uint32_t len;
+	return name(_i,len);
+}
+
+const char* jsl_view::name(int32_t _i, uint32_t& _len) const
+{
+	uint32_t count, layout;
+	if(tag() != jsl_data::TYPE_DICT || !items(count,layout) || _i < 0 || (uint32_t)_i >= count) return nullptr;
+	return text(word(payload() + 4 + _i * 8),_len);
+}
+
+bool jsl_view::get(int32_t& _val) const
+{
+	if(!valid()) return false;
+	switch(tag())
+	{
+	case jsl_data::TYPE_INT:
+		_val = (int32_t)(m_ref << (32 - jsl_image::TAG_SHIFT)) >> (32 - jsl_image::TAG_SHIFT); // sign extends the payload
+		return true;
+	case jsl_image::TAG_INT32:
+		if(at(payload(),4) == nullptr) return false;
+		_val = (int32_t)word(payload());
+		return true;
+	case jsl_data::TYPE_REAL:
+	{
+		double d;
+		if(!get(d)) return false;
+		_val = (int32_t)(d + 0.5);
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool jsl_view::get(double& _val) const
+{
+	if(!valid()) return false;
+	if(tag() == jsl_data::TYPE_REAL)
+	{
+		const uint8_t* p = at(payload(),8);
+		if(p == nullptr) return false;
+		std::memcpy(&_val,p,8);
+		return true;
+	}
+	int32_t i;
+	if(!get(i)) return false;
+	_val = i;
+	return true;
+}
+
+bool jsl_view::get(bool& _val) const
+{
+	if(!valid() || tag() != jsl_data::TYPE_BOOL) return false;
+	_val = payload() != 0;
+	return true;
+}
+
+bool jsl_view::get(const char*& _val) const
+{
+	uint32_t len;
+	const char* str = valid() && tag() == jsl_data::TYPE_STR ? text(payload(),len) : nullptr;
+	if(str == nullptr) return false;
+	_val = str;
+	return true;
+}
+
+bool jsl_view::get(std::string& _val) const
+{
+	uint32_t len;
+	const char* str = valid() && tag() == jsl_data::TYPE_STR ? text(payload(),len) : nullptr;
+	if(str == nullptr) return false;
+	_val.assign(str,len);
+	return true;
+}
+
+uint32_t jsl_view::str_size() const
+{
+	uint32_t len = 0;
+	if(!valid() || tag() != jsl_data::TYPE_STR || text(payload(),len) == nullptr) return 0;
+	return len;
+}
+
+void jsl_view::encode(std::ostream& _out) const
+{
+	// Iterative as jsl_data::encode_tree
+
+	typedef struct
+	{
+		jsl_view node;
+		uint32_t item;
+		uint32_t count;
+	} frame_t;
+
+	std::vector<frame_t> stack;
+	jsl_view node = *this;
+	bool more = true;
+
+	while(more)
+	{
+		switch(node.type())
+		{
+		case jsl_data::TYPE_DICT:
+			_out << '{';
+			stack.push_back({ node, 0, (uint32_t)node.size() });
+			break;
+		case jsl_data::TYPE_VECT:
+			_out << '[';
+			stack.push_back({ node, 0, (uint32_t)node.size() });
+			break;
+		case jsl_data::TYPE_INT:
+		{
+			int32_t i = 0;
+			node.get(i);
+			_out << i;
+			break;
+		}
+		case jsl_data::TYPE_REAL:
+		{
+			double d = 0;
+			node.get(d);
+			char buf[32];
+			int n = jsl_data::format_real(d,buf,sizeof(buf));
+			if(n > 0) _out.write(buf,n);
+			break;
+		}
+		case jsl_data::TYPE_BOOL:
+			_out << (node.payload() != 0 ? "true" : "false");
+			break;
+		case jsl_data::TYPE_STR:
+		{
+			uint32_t len = 0;
+			const char* str = node.text(node.payload(),len);
+			_out.put('"');
+			if(str != nullptr) jsl_data::escape(str,len,_out);
+			_out.put('"');
+			break;
+		}
+		default:
+			_out << "null";
+			break;
+		}
+
+		// next value, closing the completed containers
+		more = false;
+		while(!more && !stack.empty())
+		{
+			frame_t& top = stack.back();
+			if(top.item < top.count)
+			{
+				if(top.item > 0) _out << ',';
+				if(top.node.tag() == jsl_data::TYPE_DICT)
+				{
+					uint32_t len = 0;
+					const char* key = top.node.name(top.item,len);
+					_out.put('"');
+					if(key != nullptr) jsl_data::escape(key,len,_out);
+					_out << "\":";
+				}
+				node = top.node[(int32_t)top.item++];
+				more = true;
+				continue;
+			}
+			_out << (top.node.tag() == jsl_data::TYPE_DICT ? '}' : ']');
+			stack.pop_back();
+		}
+	}
+}
+
+uint32_t jsl_view::word(uint32_t _off) const
+{
+	const uint8_t* p = at(_off,4);
+	if(p == nullptr) return 0;
+	uint32_t w;
+	std::memcpy(&w,p,4); // images may sit unaligned
+	return w;
+}
+
+const char* jsl_view::text(uint32_t _off, uint32_t& _len) const
+{
+	const uint8_t* p = at(_off,4);
+	if(p == nullptr) return nullptr;
+	_len = word(_off);
+	p = at(_off + 4,(uint64_t)_len + 1);
+	if(p == nullptr || p[_len] != '\0') return nullptr;
+	return (const char*)p;
+}
+
+bool jsl_view::items(uint32_t& _count, uint32_t& _layout) const
+{
+	if(!valid() || (tag() != jsl_data::TYPE_DICT && tag() != jsl_data::TYPE_VECT)) return false;
+	if(at(payload(),4) == nullptr) return false;
+
+	const uint32_t head = word(payload());
+	_count = head & jsl_image::COUNT_MASK;
+	_layout = head >> jsl_image::LAYOUT_SHIFT;
+
+	uint32_t width;
+	if(tag() == jsl_data::TYPE_DICT) width = _layout == jsl_image::LAYOUT_REFS ? 8 : 0;
+	else if(_layout == jsl_image::LAYOUT_REALS) width = 8;
+	else width = _layout <= jsl_image::LAYOUT_INTS ? 4 : 0;
+
+	return width != 0 && at(payload() + 4,(uint64_t)_count * width) != nullptr;
+}
+
+jsl_view jsl_view::child(uint32_t _ref) const
+{
+	const uint32_t t = _ref >> jsl_image::TAG_SHIFT;
+	if((t == jsl_data::TYPE_DICT || t == jsl_data::TYPE_VECT) && (_ref & jsl_image::PAYLOAD_MASK) <= payload()) return jsl_view();
+	return jsl_view(m_base,m_size,_ref);
+}
@@ -0,0 +1,177 @@
+/*
+	jsl-image.h
+
+	This scource file is part of the jsl-esp32 project.
+
+	Author: Lorenzo Pastrana
+	Copyright © 2019 Lorenzo Pastrana
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your
+	option) any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+	for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+
+#ifndef JSL_IMAGE_H
+#define JSL_IMAGE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "jsl-data.h"
+
+
+
+// Precompiled documents : a tree serialized once (at build time, see
+// tools/jsl-mkimage.cpp) into a position independent image that is read in
+// place, from flash or a jsl_filemap, with no parse and no pool.
+//
+//	jsl_filemap file;
+//	file.open("/spiffs/config.jsli");
+//	jsl_view config = jsl_image::open(file.data(),file.size());
+//	int32_t port;
+//	if(config["net"].get("port",port)) { ... }
+//
+// Layout (little endian, 32-bit words, offsets from the image start) :
+//	header : "JSLI", version, image size, root ref
+//	ref : type << 29 | payload, the payload being the value of a null, a bool or
+//	      an int within ±2^28 and the offset of the record for the others
+//	str : size, bytes, NUL (so they read as C strings), padded to a word
+//	real : 8 bytes
+//	int32 : 4 bytes, an int out of the ref range (type TAG_INT32)
+//	dict : count, then count (key str offset, ref) pairs sorted by key
+//	vect : count | layout << 30, then count refs, int32 or doubles
+// Identical strings (keys mostly) are written once. Containers always follow
+// the one holding them, so walking a damaged image can't loop.
+
+class jsl_view;
+
+class jsl_image
+{
+public:
+
+	enum {
+		VERSION = 1,
+		HEADER_SIZE = 16
+	};
+
+	// Appends the image of _root to _image, false when it outgrows the
+	// 29-bit offsets (512MB)
+	static bool build(const jsl_data& _root, std::string& _image);
+
+	// Root of an image kept alive by the caller, invalid when the header does
+	// not check (magic, version, size, byte order)
+	static jsl_view open(const void* _image, size_t _size);
+
+protected:
+
+	friend class jsl_view;
+	friend class jsl_literal; // lays images out at compile time
+
+	enum {
+		TAG_SHIFT = 29,
+		TAG_INT32 = 7, // an int stored out of line, the other tags are node types
+		LAYOUT_SHIFT = 30,
+		LAYOUT_REFS = 0,
+		LAYOUT_INTS = 1,
+		LAYOUT_REALS = 2
+	};
+	static constexpr uint32_t PAYLOAD_MASK = (1u << TAG_SHIFT) - 1;
+	static constexpr uint32_t COUNT_MASK = (1u << LAYOUT_SHIFT) - 1;
+
+	static constexpr uint32_t ref(uint32_t _tag, uint32_t _payload) { return _tag << TAG_SHIFT | (_payload & PAYLOAD_MASK); }
+};
+
+
+
+// Read only handle on a value of an image : a pointer, the image size and a
+// ref, cheap to copy. Every read is bounds checked against the image, a
+// missing member or a damaged image gives an invalid view (type TYPE_NULL)
+// and getters that return false.
+
+class jsl_view
+{
+public:
+
+	jsl_view() :
+		m_base(nullptr),
+		m_size(0),
+		m_ref(0)
+	{}
+
+	inline bool valid() const { return m_base != nullptr; }
+	inline explicit operator bool () const { return valid(); }
+
+	jsl_data::node_type_t type() const;
+
+	// Props of a dict, items of a vect, 0 otherwise
+	int32_t size() const;
+
+	// Member lookup, a binary search over the sorted keys
+	jsl_view operator[] (const char* _name) const;
+	jsl_view operator[] (const std::string& _name) const { return find(_name.data(),_name.size()); }
+
+	// Item of a vect, or value of the _i-th prop of a dict (with name(_i))
+	jsl_view operator[] (int32_t _i) const;
+	const char* name(int32_t _i) const; // nullptr out of range
+
+	// As the container getters : numbers convert into each other, false on
+	// another type. Strings point into the image.
+	bool get(int32_t& _val) const;
+	bool get(double& _val) const;
+	bool get(bool& _val) const;
+	bool get(const char*& _val) const;
+	bool get(std::string& _val) const;
+	uint32_t str_size() const; // 0 unless a string
+
+	template<typename T>
+	inline bool get(const char* _name, T& _val) const { return (*this)[_name].get(_val); }
+	template<typename T>
+	inline bool get(int32_t _i, T& _val) const { return (*this)[_i].get(_val); }
+
+	void encode(std::ostream& _out) const; // compact JSON, as jsl_data::encode
+
+protected:
+
+	friend class jsl_image;
+
+	jsl_view(const uint8_t* _base, uint32_t _size, uint32_t _ref) :
+		m_base(_base),
+		m_size(_size),
+		m_ref(_ref)
+	{}
+
+	jsl_view find(const char* _name, size_t _len) const;
+
+	inline uint32_t tag() const { return m_ref >> jsl_image::TAG_SHIFT; }
+	inline uint32_t payload() const { return m_ref & jsl_image::PAYLOAD_MASK; }
+
+	// _len bytes at _off, nullptr when they fall out of the image
+	inline const uint8_t* at(uint32_t _off, uint64_t _len) const
+	{
+		return (uint64_t)_off + _len <= m_size ? m_base + _off : nullptr;
+	}
+	uint32_t word(uint32_t _off) const; // 0 out of the image
+	const char* text(uint32_t _off, uint32_t& _len) const; // str record, nullptr when damaged
+	const char* name(int32_t _i, uint32_t& _len) const;
+	bool items(uint32_t& _count, uint32_t& _layout) const; // false unless a valid container
+	jsl_view child(uint32_t _ref) const; // invalid unless a container lies past this one
+
+	const uint8_t* m_base;
+	uint32_t m_size;
+	uint32_t m_ref;
+};
+
+#endif // #ifndef JSL_IMAGE_H
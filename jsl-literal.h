@@ -0,0 +1,577 @@
+/*
+	jsl-literal.h
+
+	This scource file is part of the jsl-esp32 project.
+
+	Author: Lorenzo Pastrana
+	Copyright © 2019 Lorenzo Pastrana
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your
+	option) any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+	for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+
+#ifndef JSL_LITERAL_H
+#define JSL_LITERAL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "jsl-image.h"
+
+
+
+// Compile time json : JSL_LITERAL has the compiler parse a json string literal
+// into a jsl_image that sits in read only data, queried through a jsl_view.
+// Nothing is parsed, hired or allocated at run time, and a malformed literal
+// fails the build (the diagnostic names a json_..._error below).
+//
+//	static const jsl_view defaults = JSL_LITERAL(R"({"net":{"port":80,"host":"esp32"}})");
+//	int32_t port;
+//	defaults["net"].get("port",port);
+//
+// Meant for small documents (defaults, schemas) : constexpr evaluation is bounded
+// by the compiler, larger ones go through tools/jsl-mkimage. Reals are exact up
+// to 15 digits within 1e±22 and may be an ulp away from strtod beyond.
+
+#define JSL_LITERAL(_json) \
+	([]() -> jsl_view \
+	{ \
+		struct src { static constexpr const char* json() { return _json; } }; \
+		static constexpr auto image = jsl_literal::compile<jsl_literal::measure(src::json())>(src::json()); \
+		return jsl_image::open(image.data(),image.size()); \
+	}())
+
+class jsl_literal
+{
+public:
+
+	// Image size of _json, the first of two passes
+	static constexpr size_t measure(const char* _json)
+	{
+		counter_t out;
+		build(_json,out);
+		return out.size;
+	}
+
+	template<size_t N>
+	static constexpr std::array<uint8_t, N> compile(const char* _json)
+	{
+		writer_t<N> out;
+		build(_json,out);
+		return out.bytes;
+	}
+
+protected:
+
+	enum {
+		DEPTH = 32
+	};
+	static constexpr uint64_t MANT_MAX = 100000000000000000ull; // digits kept in a mantissa
+
+	// Not constexpr : reaching one of these while compiling a literal stops the build
+	static void json_syntax_error() {}
+	static void json_number_out_of_range() {}
+	static void json_duplicate_key() {}
+	static void json_too_deep() {}
+
+	struct counter_t
+	{
+		size_t size = 0;
+		static constexpr bool writes = false;
+
+		constexpr void put(uint8_t) { ++size; }
+		constexpr void set(size_t, uint32_t) {}
+		constexpr uint8_t byte(size_t) const { return 0; }
+	};
+
+	template<size_t N>
+	struct writer_t
+	{
+		std::array<uint8_t, N> bytes {};
+		size_t size = 0;
+		static constexpr bool writes = true;
+
+		constexpr void put(uint8_t _byte) { bytes[size++] = _byte; }
+		constexpr void set(size_t _off, uint32_t _word)
+		{
+			for(size_t b = 0; b < 4; ++b) bytes[_off + b] = (uint8_t)(_word >> (b * 8));
+		}
+		constexpr uint8_t byte(size_t _off) const { return bytes[_off]; }
+	};
+
+	template<typename out_t>
+	static constexpr void put32(out_t& _out, uint32_t _word)
+	{
+		for(size_t b = 0; b < 4; ++b) _out.put((uint8_t)(_word >> (b * 8)));
+	}
+
+	template<typename out_t>
+	static constexpr uint32_t word(const out_t& _out, size_t _off)
+	{
+		uint32_t word = 0;
+		for(size_t b = 0; b < 4; ++b) word |= (uint32_t)_out.byte(_off + b) << (b * 8);
+		return word;
+	}
+
+	template<typename out_t>
+	static constexpr void build(const char* _json, out_t& _out)
+	{
+		// Same layout as jsl_image::build, driven by the text : a container
+		// record is laid out when it opens (its members counted ahead), its
+		// refs filled in as the members are read and its keys sorted on close.
+		// Strings are not shared.
+
+		struct frame_t
+		{
+			size_t first; // first ref (dicts : key, ref pairs)
+			size_t slot; // next ref or number to fill in
+			size_t end;
+			uint32_t layout;
+			bool dict;
+		};
+		frame_t stack[DEPTH] = {};
+		size_t depth = 0;
+
+		_out.put('J');
+		_out.put('S');
+		_out.put('L');
+		_out.put('I');
+		put32(_out,jsl_image::VERSION);
+		put32(_out,0); // size, once known
+		put32(_out,0); // root
+
+		size_t p = space(_json,0);
+		for(;;)
+		{
+			frame_t* top = depth > 0 ? &stack[depth - 1] : nullptr;
+			if(top != nullptr && top->layout != jsl_image::LAYOUT_REFS)
+			{
+				// an item of a packed vect, straight into its array
+				num_t num;
+				if(!scan_num(_json,p,num)) return;
+				if(top->layout == jsl_image::LAYOUT_INTS)
+				{
+					_out.set(top->slot,(uint32_t)num.int32());
+					top->slot += 4;
+				}
+				else
+				{
+					const uint64_t bits = num.bits();
+					_out.set(top->slot,(uint32_t)bits);
+					_out.set(top->slot + 4,(uint32_t)(bits >> 32));
+					top->slot += 8;
+				}
+			}
+			else if(_json[p] == '{' || _json[p] == '[')
+			{
+				// a value at p, its ref goes to the open container or the header
+				const size_t slot = top != nullptr ? top->slot : 12;
+				if(top != nullptr) top->slot += 4;
+				if(depth == DEPTH) { json_too_deep(); return; }
+
+				const bool dict = _json[p] == '{';
+				uint32_t layout = jsl_image::LAYOUT_REFS;
+				const uint32_t count = members(_json,p,layout);
+				const size_t record = _out.size;
+				if(dict) layout = jsl_image::LAYOUT_REFS;
+				put32(_out,count | layout << jsl_image::LAYOUT_SHIFT);
+
+				frame_t& open = stack[depth++];
+				open.dict = dict;
+				open.layout = layout;
+				open.first = open.slot = _out.size;
+				const uint32_t words = dict ? count * 2 : layout == jsl_image::LAYOUT_REALS ? count * 2 : count;
+				for(uint32_t i = 0; i < words; ++i) put32(_out,0);
+				open.end = _out.size;
+				_out.set(slot,jsl_image::ref(dict ? jsl_data::TYPE_DICT : jsl_data::TYPE_VECT,record));
+				++p;
+			}
+			else
+			{
+				const size_t slot = top != nullptr ? top->slot : 12;
+				if(top != nullptr) top->slot += 4;
+				_out.set(slot,scalar(_json,p,_out));
+			}
+
+			// next value : closes the completed containers, reads the separator and key
+			for(;;)
+			{
+				p = space(_json,p);
+				if(depth == 0)
+				{
+					if(_json[p] != '\0') json_syntax_error();
+					_out.set(8,(uint32_t)_out.size);
+					return;
+				}
+
+				frame_t& top = stack[depth - 1];
+				if(_json[p] == (top.dict ? '}' : ']'))
+				{
+					if(top.slot != top.end) { json_syntax_error(); return; }
+					if(top.dict) sort(_out,top.first,top.end);
+					--depth;
+					++p;
+					continue;
+				}
+				if(top.slot != top.first)
+				{
+					if(_json[p] != ',') { json_syntax_error(); return; }
+					p = space(_json,p + 1);
+				}
+				if(top.slot == top.end) { json_syntax_error(); return; }
+				if(top.dict)
+				{
+					if(_json[p] != '"') { json_syntax_error(); return; }
+					_out.set(top.slot,str(_json,p,_out));
+					top.slot += 4;
+					p = space(_json,p);
+					if(_json[p] != ':') { json_syntax_error(); return; }
+					p = space(_json,p + 1);
+				}
+				break;
+			}
+		}
+	}
+
+	static constexpr bool is_space(char _c) { return _c == ' ' || _c == '\t' || _c == '\n' || _c == '\r'; }
+	static constexpr bool is_digit(char _c) { return _c >= '0' && _c <= '9'; }
+
+	static constexpr size_t space(const char* _json, size_t _p)
+	{
+		while(is_space(_json[_p])) ++_p;
+		return _p;
+	}
+
+	// Members of the container opening at _p, counted ahead so its record
+	// can be laid out first (the parse itself checks the syntax). _layout
+	// tells whether a vect packs, as the parser would : numbers only, a real
+	// among ints promotes the lot.
+	static constexpr uint32_t members(const char* _json, size_t _p, uint32_t& _layout)
+	{
+		uint32_t count = 0;
+		int32_t depth = 0;
+		bool item = false; // one started at the container level
+		bool reals = false, others = false;
+		for(++_p; _json[_p] != '\0'; ++_p)
+		{
+			const char c = _json[_p];
+			if(is_space(c)) continue;
+			if(depth == 0 && !item && c != '}' && c != ']')
+			{
+				item = true;
+				++count;
+				num_t num;
+				if((c == '-' || is_digit(c)) && scan_num(_json,_p,num))
+				{
+					reals = reals || !num.intg;
+					--_p; // on the char after the number
+					continue;
+				}
+				others = true;
+			}
+			if(c == '"')
+			{
+				while(_json[++_p] != '"')
+				{
+					if(_json[_p] == '\0') return count;
+					if(_json[_p] == '\\' && _json[_p + 1] != '\0') ++_p;
+				}
+			}
+			else if(c == '{' || c == '[') ++depth;
+			else if((c == '}' || c == ']') && depth-- == 0) break;
+			else if(c == ',' && depth == 0) item = false;
+		}
+		_layout = count == 0 || others ? jsl_image::LAYOUT_REFS : reals ? jsl_image::LAYOUT_REALS : jsl_image::LAYOUT_INTS;
+		return count;
+	}
+
+	template<typename out_t>
+	static constexpr uint32_t scalar(const char* _json, size_t& _p, out_t& _out)
+	{
+		switch(_json[_p])
+		{
+		case '"':
+			return jsl_image::ref(jsl_data::TYPE_STR,str(_json,_p,_out));
+		case 't':
+			if(match(_json,_p,"true")) return jsl_image::ref(jsl_data::TYPE_BOOL,1);
+			break;
+		case 'f':
+			if(match(_json,_p,"false")) return jsl_image::ref(jsl_data::TYPE_BOOL,0);
+			break;
+		case 'n':
+			if(match(_json,_p,"null")) return jsl_image::ref(jsl_data::TYPE_NULL,0);
+			break;
+		default:
+			if(_json[_p] == '-' || is_digit(_json[_p])) return num(_json,_p,_out);
+			break;
+		}
+		json_syntax_error();
+		return 0;
+	}
+
+	static constexpr bool match(const char* _json, size_t& _p, const char* _lit)
+	{
+		size_t i = 0;
+		for(; _lit[i] != '\0'; ++i) if(_json[_p + i] != _lit[i]) return false;
+		_p += i;
+		return true;
+	}
+
+	// str record of the string opening at _p, escapes decoded
+	template<typename out_t>
+	static constexpr uint32_t str(const char* _json, size_t& _p, out_t& _out)
+	{
+		const size_t record = _out.size;
+		put32(_out,0); // size, once known
+		uint32_t len = 0;
+
+		for(++_p; _json[_p] != '"'; ++_p)
+		{
+			char c = _json[_p];
+			if(c == '\0') { json_syntax_error(); return 0; }
+			if(c == '\\')
+			{
+				switch(_json[++_p])
+				{
+				case '"': case '\\': case '/': c = _json[_p]; break;
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'n': c = '\n'; break;
+				case 'r': c = '\r'; break;
+				case 't': c = '\t'; break;
+				case 'u':
+				{
+					uint32_t code = hex4(_json,_p);
+					if(code >= 0xd800 && code < 0xdc00) // high surrogate, its pair follows
+					{
+						if(_json[_p + 1] != '\\' || _json[_p + 2] != 'u') { json_syntax_error(); return 0; }
+						_p += 2;
+						const uint32_t low = hex4(_json,_p);
+						if(low < 0xdc00 || low >= 0xe000) { json_syntax_error(); return 0; }
+						code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+					}
+					else if(code >= 0xdc00 && code < 0xe000) { json_syntax_error(); return 0; }
+					len += utf8(code,_out);
+					continue;
+				}
+				default:
+					json_syntax_error();
+					return 0;
+				}
+			}
+			_out.put((uint8_t)c);
+			++len;
+		}
+		++_p;
+
+		for(uint32_t pad = 4 - (len & 3); pad > 0; --pad) _out.put(0); // NUL and padding
+		_out.set(record,len);
+		return record;
+	}
+
+	// the 4 hex digits after the 'u' at _p, left on the last one
+	static constexpr uint32_t hex4(const char* _json, size_t& _p)
+	{
+		uint32_t code = 0;
+		for(size_t i = 0; i < 4; ++i)
+		{
+			const char c = _json[++_p];
+			if(is_digit(c)) code = code << 4 | (c - '0');
+			else if(c >= 'a' && c <= 'f') code = code << 4 | (c - 'a' + 10);
+			else if(c >= 'A' && c <= 'F') code = code << 4 | (c - 'A' + 10);
+			else { json_syntax_error(); return 0; }
+		}
+		return code;
+	}
+
+	template<typename out_t>
+	static constexpr uint32_t utf8(uint32_t _code, out_t& _out)
+	{
+		if(_code < 0x80)
+		{
+			_out.put((uint8_t)_code);
+			return 1;
+		}
+		if(_code < 0x800)
+		{
+			_out.put((uint8_t)(0xc0 | _code >> 6));
+			_out.put((uint8_t)(0x80 | (_code & 0x3f)));
+			return 2;
+		}
+		if(_code < 0x10000)
+		{
+			_out.put((uint8_t)(0xe0 | _code >> 12));
+			_out.put((uint8_t)(0x80 | (_code >> 6 & 0x3f)));
+			_out.put((uint8_t)(0x80 | (_code & 0x3f)));
+			return 3;
+		}
+		_out.put((uint8_t)(0xf0 | _code >> 18));
+		_out.put((uint8_t)(0x80 | (_code >> 12 & 0x3f)));
+		_out.put((uint8_t)(0x80 | (_code >> 6 & 0x3f)));
+		_out.put((uint8_t)(0x80 | (_code & 0x3f)));
+		return 4;
+	}
+
+	struct num_t
+	{
+		uint64_t mant = 0;
+		int32_t exp = 0;
+		bool neg = false;
+		bool intg = true;
+
+		constexpr int32_t int32() const // clamped, as the parser reads an int
+		{
+			if(exp != 0 || mant > (neg ? 0x80000000ull : 0x7fffffffull)) return neg ? INT32_MIN : INT32_MAX;
+			return (int32_t)(neg ? -(int64_t)mant : (int64_t)mant);
+		}
+		constexpr uint64_t bits() const
+		{
+			if(!intg) return real_bits(neg,real(mant,exp));
+			const int32_t val = int32(); // an int -0 is 0
+			return real_bits(val < 0,val < 0 ? -(double)val : (double)val);
+		}
+	};
+
+	// The number at _p, left past it
+	static constexpr bool scan_num(const char* _json, size_t& _p, num_t& _num)
+	{
+		_num.neg = _json[_p] == '-';
+		if(_num.neg) ++_p;
+		if(!is_digit(_json[_p])) { json_syntax_error(); return false; }
+
+		if(_json[_p] == '0') ++_p; // no leading zeros
+		else for(; is_digit(_json[_p]); ++_p)
+		{
+			if(_num.mant < MANT_MAX) _num.mant = _num.mant * 10 + (_json[_p] - '0');
+			else ++_num.exp;
+		}
+		if(_json[_p] == '.')
+		{
+			_num.intg = false;
+			if(!is_digit(_json[++_p])) { json_syntax_error(); return false; }
+			for(; is_digit(_json[_p]); ++_p)
+			{
+				if(_num.mant < MANT_MAX) { _num.mant = _num.mant * 10 + (_json[_p] - '0'); --_num.exp; }
+			}
+		}
+		if(_json[_p] == 'e' || _json[_p] == 'E')
+		{
+			_num.intg = false;
+			const bool neg = _json[++_p] == '-';
+			if(_json[_p] == '-' || _json[_p] == '+') ++_p;
+			if(!is_digit(_json[_p])) { json_syntax_error(); return false; }
+			int32_t exp = 0;
+			for(; is_digit(_json[_p]); ++_p) if(exp < 100000) exp = exp * 10 + (_json[_p] - '0');
+			_num.exp += neg ? -exp : exp;
+		}
+		const char c = _json[_p];
+		if(c != '\0' && c != ',' && c != ']' && c != '}' && !is_space(c)) { json_syntax_error(); return false; }
+		return true;
+	}
+
+	// Numbers as the parser reads them : ints clamped to int32, reals otherwise
+	template<typename out_t>
+	static constexpr uint32_t num(const char* _json, size_t& _p, out_t& _out)
+	{
+		num_t num;
+		if(!scan_num(_json,_p,num)) return 0;
+
+		const size_t record = _out.size;
+		if(num.intg)
+		{
+			const int32_t val = num.int32();
+			const int32_t half = jsl_image::PAYLOAD_MASK >> 1;
+			if(val >= -half - 1 && val <= half) return jsl_image::ref(jsl_data::TYPE_INT,(uint32_t)val); // fits the ref
+			put32(_out,(uint32_t)val);
+			return jsl_image::ref(jsl_image::TAG_INT32,record);
+		}
+
+		const uint64_t bits = num.bits();
+		put32(_out,(uint32_t)bits);
+		put32(_out,(uint32_t)(bits >> 32));
+		return jsl_image::ref(jsl_data::TYPE_REAL,record);
+	}
+
+	// _mant * 10^_exp, one exact step in the common range
+	static constexpr double real(uint64_t _mant, int32_t _exp)
+	{
+		double val = (double)_mant;
+		for(; _exp > 22; _exp -= 22)
+		{
+			if(val > std::numeric_limits<double>::max() / 1e22) { json_number_out_of_range(); return 0; }
+			val *= 1e22;
+		}
+		for(; _exp < -22; _exp += 22) val /= 1e22;
+
+		double scale = 1;
+		for(int32_t i = _exp < 0 ? -_exp : _exp; i > 0; --i) scale *= 10; // exact up to 1e22
+		if(_exp < 0) return val / scale;
+		if(val > std::numeric_limits<double>::max() / scale) { json_number_out_of_range(); return 0; }
+		return val * scale;
+	}
+
+	// IEEE 754 bits of a double, no bit cast before C++20
+	static constexpr uint64_t real_bits(bool _neg, double _val)
+	{
+		uint64_t bits = _neg ? 1ull << 63 : 0;
+		if(_val == 0) return bits;
+
+		int32_t exp = 0;
+		while(_val >= 2) { _val /= 2; ++exp; } // exact
+		while(_val < 1 && exp > -1022) { _val *= 2; --exp; }
+		if(_val < 1) return bits | (uint64_t)(_val * 4503599627370496.0); // subnormal
+		return bits | (uint64_t)(exp + 1023) << 52 | (uint64_t)((_val - 1) * 4503599627370496.0); // 2^52
+	}
+
+	// unsigned bytes then lengths, the dict_t key order
+	template<typename out_t>
+	static constexpr int32_t compare(const out_t& _out, uint32_t _a, uint32_t _b)
+	{
+		const uint32_t la = word(_out,_a), lb = word(_out,_b);
+		for(uint32_t i = 0; i < la && i < lb; ++i)
+		{
+			const uint8_t a = _out.byte(_a + 4 + i), b = _out.byte(_b + 4 + i);
+			if(a != b) return a < b ? -1 : 1;
+		}
+		return la < lb ? -1 : la > lb ? 1 : 0;
+	}
+
+	// Insertion sort of the (key, ref) pairs of a dict record
+	template<typename out_t>
+	static constexpr void sort(out_t& _out, size_t _first, size_t _end)
+	{
+		if(!out_t::writes) return;
+		for(size_t i = _first + 8; i < _end; i += 8)
+		{
+			const uint32_t key = word(_out,i), ref = word(_out,i + 4);
+			size_t j = i;
+			for(; j > _first; j -= 8)
+			{
+				const int32_t cmp = compare(_out,word(_out,j - 8),key);
+				if(cmp == 0) { json_duplicate_key(); return; }
+				if(cmp < 0) break;
+				_out.set(j,word(_out,j - 8));
+				_out.set(j + 4,word(_out,j - 4));
+			}
+			_out.set(j,key);
+			_out.set(j + 4,ref);
+		}
+	}
+};
+
+#endif // #ifndef JSL_LITERAL_H
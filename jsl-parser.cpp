@@ -24,6 +24,10 @@
 
 
 #include <iostream>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
 
 #define LOG_LOCAL_LEVEL ESP_LOG_NONE
 // #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
@@ -34,180 +38,812 @@ constexpr char PARSER_LOGTAG[] = "PARSER :";
 
 jsl_data_dict* jsl_parser::parse()
 {
+	JSL_STAT(timer_t timer(m_parse_us));
+
+	m_error = jsl_error();
+	m_depth = 0;
+	m_nodes = 0;
+
 	m_src.seekg(0);
-	return eat_dict();
+	eat_space();
+	jsl_data_dict* dict = eat_dict();
+
+	JSL_STAT(count_parsed());
+	return dict;
 }
 
-jsl_data_dict* jsl_parser::eat_dict()
+bool jsl_parser::reparse(jsl_data_dict& _tree)
 {
+	JSL_STAT(timer_t timer(m_parse_us));
+
+	m_error = jsl_error();
+	m_depth = 0;
+	m_nodes = 0;
+
+	m_src.seekg(0);
+	eat_space();
+
+	bool done = false;
 	if(m_src.peek() != '{')
 	{
 		ESP_LOGE(PARSER_LOGTAG, "Error : wrong init char [%c]",m_src.peek());
+		fail_char();
+	}
+	else done = eat_value(false,&_tree) != nullptr;
+
+	JSL_STAT(count_parsed());
+	return done;
+}
+
+jsl_limits jsl_parser::m_defaults;
+std::atomic<uint32_t> jsl_parser::m_hints[HINTS];
+
+jsl_stats jsl_parser::stats()
+{
+	jsl_stats stats = jsl_data_pool::stats();
+#if JSL_STATS
+	stats.parsed_bytes = m_parsed_bytes;
+	stats.copied_bytes = m_copied_bytes;
+	stats.parse_us = m_parse_us;
+	stats.num_us = m_num_us;
+	stats.str_us = m_str_us;
+	stats.lit_us = m_lit_us;
+#endif
+	return stats;
+}
+
+void jsl_parser::reset_stats()
+{
+	jsl_data_pool::reset_stats();
+#if JSL_STATS
+	m_parsed_bytes = 0;
+	m_copied_bytes = 0;
+	m_parse_us = 0;
+	m_num_us = 0;
+	m_str_us = 0;
+	m_lit_us = 0;
+#endif
+}
+
+#if JSL_STATS
+void jsl_parser::count_parsed()
+{
+	if(m_mem != nullptr)
+	{
+		m_parsed_bytes += m_mem->cur() - m_mem->begin();
+		return;
+	}
+	m_src.clear();
+	std::streamoff pos = m_src.tellg();
+	if(pos > 0) m_parsed_bytes += pos;
+}
+
+jsl_parser::counter_t jsl_parser::m_parsed_bytes(0);
+jsl_parser::counter_t jsl_parser::m_copied_bytes(0);
+jsl_parser::counter_t jsl_parser::m_parse_us(0);
+jsl_parser::counter_t jsl_parser::m_num_us(0);
+jsl_parser::counter_t jsl_parser::m_str_us(0);
+jsl_parser::counter_t jsl_parser::m_lit_us(0);
+#endif
+
+jsl_data_dict* jsl_parser::parse_file(const char* _path, jsl_error* _error)
+{
+	jsl_filemap file;
+	if(!file.open(_path))
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : parse_file open fail");
+		if(_error != nullptr)
+		{
+			*_error = jsl_error();
+			_error->code = jsl_error::ERROR_FILE;
+		}
 		return nullptr;
 	}
 
-	m_src.get();
+	// strings are copied into the nodes, the mapping can go once parsed
+	jsl_memstream src(file.data(),file.size());
+	jsl_parser parser(src);
+	jsl_data_dict* dict = parser.parse();
+
+	if(_error != nullptr)
+	{
+		*_error = parser.error();
+		if(*_error) _error->locate(file.data(),file.size()); // last chance, the mapping goes
+	}
+	return dict;
+}
+
+const jsl_error& jsl_parser::locate()
+{
+	if(!m_error || m_error.line != 0) return m_error;
 
-	jsl_data_dict* dict = jsl_data_pool::hire_dict();
-	if(dict == nullptr)
+	if(m_mem != nullptr)
 	{
-		ESP_LOGE(PARSER_LOGTAG, "Error : hire dict fail");
+		m_error.locate(m_mem->begin(),m_mem->end() - m_mem->begin());
+		return m_error;
+	}
+
+	// generic stream : read it again up to the offset
+	m_src.clear();
+	std::streampos pos = m_src.tellg();
+	m_src.seekg(0);
+
+	char buf[64];
+	size_t done = 0;
+	uint32_t line = 1, col = 1;
+	while(done < m_error.offset && m_src.read(buf,std::min(sizeof(buf),m_error.offset - done)))
+	{
+		for(size_t i = 0; i < (size_t)m_src.gcount(); ++i)
+		{
+			if(buf[i] == '\n') { ++line; col = 1; }
+			else ++col;
+		}
+		done += m_src.gcount();
+	}
+
+	m_error.line = line;
+	m_error.col = col;
+
+	m_src.clear();
+	m_src.seekg(pos);
+	return m_error;
+}
+
+void jsl_parser::fail(jsl_error::code_t _code)
+{
+	if(m_error) return;
+
+	m_error.code = _code;
+	if(m_mem != nullptr)
+	{
+		m_error.offset = m_mem->cur() - m_mem->begin();
+	}
+	else
+	{
+		m_src.clear();
+		std::streamoff pos = m_src.tellg();
+		m_error.offset = pos > 0 ? pos : 0;
+	}
+}
+
+void jsl_parser::fail_char()
+{
+	fail(m_src.peek() == std::istream::traits_type::eof() ? jsl_error::ERROR_EOF : jsl_error::ERROR_CHAR);
+}
+
+const char* jsl_error::what() const
+{
+	switch(code)
+	{
+	case ERROR_NONE: return "no error";
+	case ERROR_EOF: return "unexpected end of source";
+	case ERROR_CHAR: return "unexpected char";
+	case ERROR_NAME: return "prop-name missing or doubled";
+	case ERROR_LIT: return "bad literal";
+	case ERROR_NUM: return "bad number";
+	case ERROR_STR: return "bad string";
+	case ERROR_POOL: return "pool exhausted";
+	case ERROR_FILE: return "file not readable";
+	case ERROR_LIMIT: return "limit reached";
+	default: return "unknown error";
+	}
+}
+
+void jsl_error::locate(const char* _src, size_t _len)
+{
+	size_t end = std::min(offset,_len);
+	line = 1;
+	size_t bol = 0; // begining of line
+	for(const char* p = _src; (p = (const char*)std::memchr(p,'\n',_src + end - p)) != nullptr; ++p)
+	{
+		++line;
+		bol = p - _src + 1;
+	}
+	col = end - bol + 1;
+}
+
+jsl_data_vect* jsl_parser::parse_vect(const char* _buf, size_t _len, uint8_t _jobs, jsl_error* _error)
+{
+	JSL_STAT(timer_t timer(m_parse_us));
+	JSL_STAT(m_parsed_bytes += _len);
+
+	jsl_error error;
+
+	std::vector<const char*> cuts;
+	if(!split_vect(_buf,_len,_jobs,cuts,error))
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : parse_vect wrong array");
+		if(_error != nullptr) *_error = error;
 		return nullptr;
 	}
 
-	std::string pname;
-	jsl_data* pvalue = nullptr;
+	// cuts holds the opening bracket, the separating commas and the closing bracket
+	size_t chunks = cuts.size() - 1;
+	std::vector<jsl_data_vect> items(chunks); // off the pool, only their items are hired
+	std::vector<uint8_t> done(chunks,false);
+	std::vector<jsl_error> errors(chunks);
 
-	while(!m_src.eof())
+	auto job = [&](size_t _c)
 	{
-		if(eat_space())
+		jsl_memstream src(cuts[_c] + 1,cuts[_c + 1] - cuts[_c] - 1);
+		jsl_parser parser(src);
+		parser.m_depth = 1; // inside the top-level array
+		done[_c] = parser.eat_items(items[_c]);
+		errors[_c] = parser.error();
+		errors[_c].offset += cuts[_c] + 1 - _buf; // chunk to source offset
+	};
+
+	if(chunks == 1)
+	{
+		// empty array or a single chunk, no need for threads
+		const char* p = cuts[0] + 1;
+		while(p != cuts[1] && is_space(*p)) ++p;
+		if(p != cuts[1]) job(0);
+		else done[0] = true;
+	}
+	else
+	{
+		std::vector<std::thread> threads;
+		for(size_t c = 1; c < chunks; ++c)
 		{
-			ESP_LOGE(PARSER_LOGTAG, "Error : eat_space unexpected EOF");
-			goto abort;
-		} // EOF
+			threads.emplace_back(job,c);
+		}
+		job(0);
+		for(auto t = threads.begin(); t != threads.end(); ++t)
+		{
+			t->join();
+		}
+	}
 
-		switch(m_src.peek())
+	auto failed = std::find(done.begin(),done.end(),false);
+	bool ok = failed == done.end();
+
+	// chunks are in source order, the first failed one holds the first error
+	if(!ok) error = errors[failed - done.begin()];
+
+	jsl_data_vect* vect = nullptr;
+	if(ok && (vect = jsl_data_pool::hire_vect()) == nullptr)
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : hire vect fail");
+		error.code = jsl_error::ERROR_POOL;
+		error.offset = cuts[0] - _buf;
+	}
+
+	size_t count = 0;
+	for(auto c = items.begin(); c != items.end(); ++c)
+	{
+		count += c->size();
+	}
+
+	// chunks only know their own share, check the array as a whole
+	if(vect != nullptr && count > m_defaults.items)
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : parse_vect items limit");
+		jsl_data_pool::fire(*vect);
+		vect = nullptr;
+		error.code = jsl_error::ERROR_LIMIT;
+		error.offset = cuts[0] - _buf;
+	}
+
+	if(vect != nullptr && !items[0].packed()) vect->reserve(count);
+
+	// stitch the chunks in order, or hand everything back to the pool,
+	// packed chunks append their numbers to a packed vect
+	for(auto c = items.begin(); c != items.end(); ++c)
+	{
+		if(vect != nullptr) vect->splice(*c);
+		if(c->size() == 0) continue;
+		if(vect != nullptr)
+		{
+			ESP_LOGE(PARSER_LOGTAG, "Error : parse_vect unpack fail");
+			error.code = jsl_error::ERROR_POOL;
+			error.offset = cuts[0] - _buf;
+		}
+		c->erase(0,c->size());
+	}
+
+	if(vect != nullptr && error.code != jsl_error::ERROR_NONE)
+	{
+		jsl_data_pool::fire(*vect);
+		vect = nullptr;
+	}
+
+	if(_error != nullptr) *_error = error;
+
+	return vect;
+}
+
+bool jsl_parser::split_vect(const char* _buf, size_t _len, uint8_t _jobs, std::vector<const char*>& _cuts, jsl_error& _error)
+{
+	const char* p = _buf;
+	const char* end = _buf + _len;
+
+	_error.code = jsl_error::ERROR_EOF;
+	_error.offset = _len;
+
+	while(p != end && is_space(*p)) ++p;
+	if(p == end) return false;
+	if(*p != '[')
+	{
+		_error.code = jsl_error::ERROR_CHAR;
+		_error.offset = p - _buf;
+		return false;
+	}
+
+	_cuts.push_back(p);
+
+	if(_jobs == 0) _jobs = 1;
+	size_t step = (end - p) / _jobs;
+	const char* next = p + step;
+
+	std::vector<char> closers; // of the open brackets
+	bool str = false;
+
+	// structural pre-scan : only strings and brackets matter here
+	for(; p != end; ++p)
+	{
+		if(str)
 		{
-		case '"': // prop name
-			if(!pname.empty())
+			if(*p == '\\')
 			{
-				ESP_LOGE(PARSER_LOGTAG, "Error : prop-name already there");
-				goto abort;
+				if(++p == end) return false;
 			}
-			if(scan_str(pname))
+			else if(*p == '"') str = false;
+			continue;
+		}
+
+		switch(*p)
+		{
+		case '"':
+			str = true;
+			break;
+		case '[':
+			closers.push_back(']');
+			break;
+		case '{':
+			closers.push_back('}');
+			break;
+		case ']':
+		case '}':
+			if(closers.empty() || closers.back() != *p)
 			{
-				ESP_LOGE(PARSER_LOGTAG, "Error : scan_str unexpected EOF");
-				goto abort;
-			} // EOF
+				_error.code = jsl_error::ERROR_CHAR;
+				_error.offset = p - _buf;
+				return false;
+			}
+			closers.pop_back();
+			if(closers.empty())
+			{
+				_cuts.push_back(p);
+				const char* tail = p + 1;
+				while(tail != end && is_space(*tail)) ++tail;
+				if(tail != end)
+				{
+					_error.code = jsl_error::ERROR_CHAR;
+					_error.offset = tail - _buf;
+					return false;
+				}
+				_error.code = jsl_error::ERROR_NONE;
+				_error.offset = 0;
+				return true;
+			}
+			break;
+		case ',':
+			if(closers.size() == 1 && p >= next)
+			{
+				_cuts.push_back(p);
+				next = p + step;
+			}
 			break;
-		case ':': // prop val
-			if(pname.empty())
+		default:
+			break;
+		}
+	}
+
+	return false; // unexpected EOF
+}
+
+bool jsl_parser::eat_items(jsl_data_vect& _items)
+{
+	jsl_data* pvalue = nullptr;
+	int c;
+
+	while(true)
+	{
+		// numbers pack as long as the chunk holds nothing else
+		c = eat_space() ? std::istream::traits_type::eof() : m_src.peek();
+		if((c == '-' || (c >= '0' && c <= '9')) && (_items.packed() || _items.size() == 0))
+		{
+			if(eat_packed(_items))
 			{
-				ESP_LOGE(PARSER_LOGTAG, "Error : prop-name was not there");
+				ESP_LOGE(PARSER_LOGTAG, "Error : eat_packed fail");
 				goto abort;
 			}
-			m_src.get();
-			pvalue = eat_value();
+		}
+		else
+		{
+			pvalue = eat_value(true);
 			if(!pvalue)
 			{
 				ESP_LOGE(PARSER_LOGTAG, "Error : eat_value fail");
 				goto abort;
 			}
-			dict->set_prop(pname,*pvalue);
-			pvalue = nullptr;
-			pname = "";
-			break;
-		case ',': // next
-			if(!pname.empty())
+
+			if(!_items.push_slot(pvalue))
 			{
-				ESP_LOGE(PARSER_LOGTAG, "Error : ");
+				ESP_LOGE(PARSER_LOGTAG, "Error : push_slot fail");
+				if(jsl_data::is_node(pvalue)) pvalue->fire();
+				fail(jsl_error::ERROR_POOL);
 				goto abort;
 			}
+			pvalue = nullptr;
+		}
+
+		if((uint32_t)_items.size() > m_limits.items)
+		{
+			ESP_LOGE(PARSER_LOGTAG, "Error : items limit");
+			fail(jsl_error::ERROR_LIMIT);
+			goto abort;
+		}
+
+		eat_space();
+
+		switch(m_src.peek())
+		{
+		case std::istream::traits_type::eof(): // end of chunk
+			return true;
+		case ',': // next
 			m_src.get();
 			break;
-		case '}': // end
-			m_src.get();
-			return dict;
 		default:
 			ESP_LOGE(PARSER_LOGTAG, "unexpected char [%c]",m_src.peek());
+			fail(jsl_error::ERROR_CHAR);
 			goto abort; // invalid src
 		}
 	}
 
-	ESP_LOGE(PARSER_LOGTAG, "Error : eat_dict unexpected EOF");
-	return nullptr; // EOF
-
 abort:
 
-	ESP_LOGE(PARSER_LOGTAG, "Error : eat_dict aborted");
-	jsl_data_pool::fire(*dict);
-	return nullptr; // aborted
+	ESP_LOGE(PARSER_LOGTAG, "Error : eat_items aborted");
+	_items.erase(0,_items.size());
+	return false;
 }
 
-jsl_data_vect* jsl_parser::eat_vect()
+jsl_data_dict* jsl_parser::eat_dict()
 {
-	if(m_src.peek() != '[')
+	if(m_src.peek() != '{')
 	{
 		ESP_LOGE(PARSER_LOGTAG, "Error : wrong init char [%c]",m_src.peek());
+		fail_char();
 		return nullptr;
 	}
 
+	return (jsl_data_dict*)eat_value();
+}
+
+jsl_data* jsl_parser::eat_value(bool _slot, jsl_data* _former)
+{
+	// Iterative descent : open dicts and vects live in m_stack, not on the
+	// call stack, so the nesting depth only costs heap (see jsl_limits)
+
+	const size_t base = m_top; // frames below belong to the caller
+	jsl_data* value = nullptr;
+	jsl_data* former = nullptr; // what the value replaces in a reused container
+	frame_t* top = nullptr;
+	int c;
+
+value: // a value is expected
+
+	if(eat_space())
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : no food");
+		fail(jsl_error::ERROR_EOF);
+		goto abort;
+	} // EOF
+
+	c = m_src.peek();
+	former = m_top == base ? _former : former_of(*top);
+	if(m_top > base && top->close == ']' && (c == '-' || (c >= '0' && c <= '9')))
+	{
+		// numbers go straight to the packed array while the vect holds nothing else
+		jsl_data_vect* vect = (jsl_data_vect*)top->node;
+		if(vect->packed() || vect->size() == 0)
+		{
+			if(eat_packed(*vect))
+			{
+				ESP_LOGE(PARSER_LOGTAG, "Error : eat_packed fail");
+				goto abort;
+			}
+			if((uint32_t)vect->size() > m_limits.items)
+			{
+				ESP_LOGE(PARSER_LOGTAG, "Error : items limit");
+				fail(jsl_error::ERROR_LIMIT);
+				goto abort;
+			}
+			goto next;
+		}
+	}
+	if(c == '{' || c == '[')
+	{
+		top = open(c == '{',former);
+		if(top == nullptr) goto abort;
+
+		if(eat_space())
+		{
+			ESP_LOGE(PARSER_LOGTAG, "Error : eat_space unexpected EOF");
+			fail(jsl_error::ERROR_EOF);
+			goto abort;
+		} // EOF
+
+		if(m_src.peek() == top->close) // empty
+		{
+			m_src.get();
+			goto close;
+		}
+		if(top->close == '}') goto name;
+		goto value;
+	}
+
+	value = eat_scalar(c,former);
+	if(value == nullptr) goto abort;
+
+attach: // value is complete
+
+	if(m_top == base)
+	{
+		// the caller gets a node, immediates only live in container slots
+		if(jsl_data::is_imm(value) && !_slot)
+		{
+			jsl_data* node = jsl_data::node_for(value);
+			if(node == nullptr)
+			{
+				fail(jsl_error::ERROR_POOL);
+				goto abort;
+			}
+			value = node;
+		}
+		return value;
+	}
+
+	top = &m_stack[m_top - 1];
+	if(top->close == '}')
+	{
+		jsl_data_dict* dict = (jsl_data_dict*)top->node;
+		if(!top->held.empty()) value = dict->put(top->held,value); // reparse, the key is known
+		else
+		{
+			JSL_STAT(m_copied_bytes += top->name.size());
+			value = dict->put(top->name.c_str(),value); // a duplicate key hands the former value back
+		}
+		if(jsl_data::is_node(value)) value->fire();
+		value = nullptr;
+		if((uint32_t)dict->size() > m_limits.items)
+		{
+			ESP_LOGE(PARSER_LOGTAG, "Error : items limit");
+			fail(jsl_error::ERROR_LIMIT);
+			goto abort;
+		}
+	}
+	else
+	{
+		jsl_data_vect* vect = (jsl_data_vect*)top->node;
+		if(top->met < top->items)
+		{
+			value = vect->put(top->met++,value); // reparse, over a former item
+			if(jsl_data::is_node(value)) value->fire();
+		}
+		else if(!vect->push_slot(value))
+		{
+			fail(jsl_error::ERROR_POOL);
+			goto abort; // value is still ours
+		}
+		value = nullptr;
+		if((uint32_t)vect->size() > m_limits.items)
+		{
+			ESP_LOGE(PARSER_LOGTAG, "Error : items limit");
+			fail(jsl_error::ERROR_LIMIT);
+			goto abort;
+		}
+	}
+
+next: // a separator or the end of the container is expected
+
+	if(eat_space())
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : eat_space unexpected EOF");
+		fail(jsl_error::ERROR_EOF);
+		goto abort;
+	} // EOF
+
+	c = m_src.peek();
+	if(c == ',')
+	{
+		m_src.get();
+		if(top->close == '}') goto name;
+		goto value;
+	}
+	if(c == top->close)
+	{
+		m_src.get();
+		goto close;
+	}
+
+	ESP_LOGE(PARSER_LOGTAG, "unexpected char [%c]",c);
+	fail_char();
+	goto abort; // invalid src
+
+name: // a prop-name is expected
+
+	if(eat_space())
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : eat_space unexpected EOF");
+		fail(jsl_error::ERROR_EOF);
+		goto abort;
+	} // EOF
+
+	if(m_src.peek() != '"')
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : prop-name was not there");
+		fail(jsl_error::ERROR_NAME);
+		goto abort;
+	}
+
+	top->name.clear(); // keeps its capacity for the next prop-names
+	if(scan_str(top->name))
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : scan_str unexpected EOF");
+		goto abort;
+	} // EOF
+
+	eat_space();
+	if(m_src.peek() != ':')
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : prop-value was not there");
+		fail_char();
+		goto abort;
+	}
 	m_src.get();
 
-	jsl_data_vect* vect = jsl_data_pool::hire_vect();
-	if(vect == nullptr)
+	if(!m_ignored.empty() && m_ignored.count(top->name) != 0)
 	{
-		ESP_LOGE(PARSER_LOGTAG, "Error : hire vect fail");
-		return nullptr;
+		if(skip_value())
+		{
+			ESP_LOGE(PARSER_LOGTAG, "Error : skip_value fail");
+			goto abort;
+		}
+		goto next;
 	}
+	if(top->reuse) top->held = top->spare.extract(top->name); // empty when the key is new
+	goto value;
 
-	jsl_data* pvalue = nullptr;
+close: // the top container is complete
+
+	value = top->node;
+	settle(*top,false);
+	if(top->close == ']')
+	{
+		jsl_data_vect* vect = (jsl_data_vect*)value;
+		uint32_t items = std::min<uint32_t>(vect->size(),HINT_MAX);
+		uint32_t packed = !vect->packed() ? 0 : vect->m_packed->type == jsl_data::TYPE_REAL ? 3 : 1;
+		m_hints[top->path % HINTS].store(items << 2 | packed,std::memory_order_relaxed);
+	}
+	--m_top;
+	--m_depth;
+	goto attach;
+
+abort:
+
+	ESP_LOGE(PARSER_LOGTAG, "Error : eat_value aborted");
+	if(jsl_data::is_node(value)) value->fire();
+	while(m_top > base)
+	{
+		// each open container holds its members, not yet attached to its parent,
+		// reused ones are still part of the tree and stay there
+		frame_t& frame = m_stack[--m_top];
+		if(frame.reuse) settle(frame,true);
+		else frame.node->fire();
+		--m_depth;
+	}
+	return nullptr; // aborted
+}
+
+jsl_parser::frame_t* jsl_parser::open(bool _dict, jsl_data* _former)
+{
+	if(m_depth >= m_limits.depth)
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : depth limit");
+		fail(jsl_error::ERROR_LIMIT);
+		return nullptr;
+	}
 
-	while(!m_src.eof())
+	// FNV-1a over the prop-names down to here
+	uint32_t path = 2166136261u ^ m_depth;
+	if(m_top > 0)
 	{
-		pvalue = eat_value();
-		if(!pvalue)
+		const frame_t& parent = m_stack[m_top - 1];
+		path = parent.path;
+		if(parent.close == '}')
 		{
-			ESP_LOGE(PARSER_LOGTAG, "Error : eat_value fail");
-			goto abort;
+			for(auto ch = parent.name.begin(); ch != parent.name.end(); ++ch) path = (path ^ (uint8_t)*ch) * 16777619u;
 		}
+		else path = (path ^ '[') * 16777619u;
+	}
 
-		vect->push_back(*pvalue);
-		pvalue = nullptr;
-
-		if(eat_space())
-		{
-			ESP_LOGE(PARSER_LOGTAG, "Error : eat_space unexpected EOF");
-			goto abort;
-		} // EOF
+	jsl_data* node = nullptr;
+	bool reuse = jsl_data::is_node(_former) && _former->type() == (_dict ? jsl_data::TYPE_DICT : jsl_data::TYPE_VECT);
+	if(reuse) node = _former;
+	else
+	{
+		if(count_node()) return nullptr;
 
-		switch(m_src.peek())
+		uint32_t hint = _dict ? 0 : m_hints[path % HINTS].load(std::memory_order_relaxed);
+		size_t items = hint >> 2;
+		bool packed = (hint & 1) != 0; // the items go to a packed array, the vect holds no slot
+		node = _dict ? (jsl_data*)jsl_data_pool::hire_dict() : (jsl_data*)jsl_data_pool::hire_vect(packed ? 0 : items);
+		if(node == nullptr)
 		{
-		case ',': // next
-			m_src.get();
-			break;
-		case ']': // end
-			m_src.get();
-			return vect;
-		default:
-			ESP_LOGE(PARSER_LOGTAG, "unexpected char [%c]",m_src.peek());
-			goto abort; // invalid src
+			ESP_LOGE(PARSER_LOGTAG, "Error : hire %s fail",_dict ? "dict" : "vect");
+			fail(jsl_error::ERROR_POOL);
+			return nullptr;
 		}
-
+		if(items != 0 && packed) ((jsl_data_vect*)node)->reserve_packed(items,(hint & 2) != 0);
+		else if(items != 0) ((jsl_data_vect*)node)->reserve(items);
 	}
 
-	ESP_LOGE(PARSER_LOGTAG, "Error : eat_vect unexpected EOF");
-	return nullptr; // EOF
+	m_src.get();
 
-abort:
+	// frames are never popped from the vector so their name strings keep their capacity
+	if(m_top == m_stack.size()) m_stack.emplace_back();
+
+	frame_t& frame = m_stack[m_top++];
+	frame.node = node;
+	frame.close = _dict ? '}' : ']';
+	frame.reuse = reuse;
+	frame.path = path;
+	frame.met = 0;
+	frame.items = 0;
+	if(reuse && _dict) ((jsl_data_dict*)node)->lend(frame.spare);
+	if(reuse && !_dict) frame.items = ((jsl_data_vect*)node)->lend();
+	++m_depth;
+	return &frame;
+}
 
-	ESP_LOGE(PARSER_LOGTAG, "Error : eat_vect aborted");
-	jsl_data_pool::fire(*vect);
-	return nullptr; // aborted
+jsl_data* jsl_parser::former_of(const frame_t& _frame) const
+{
+	if(!_frame.reuse) return nullptr;
+	if(_frame.close == '}') return _frame.held.empty() ? nullptr : _frame.held.mapped();
+	if(_frame.met < _frame.items) return ((jsl_data_vect*)_frame.node)->m_container[_frame.met];
+	return nullptr;
 }
 
-jsl_data* jsl_parser::eat_value()
+void jsl_parser::settle(frame_t& _frame, bool _abort)
 {
-	if(eat_space())
+	if(!_frame.reuse) return;
+	if(_frame.close == '}')
 	{
-		ESP_LOGE(PARSER_LOGTAG, "Error : no food");
-		return nullptr;
-	} // EOF
+		jsl_data_dict* dict = (jsl_data_dict*)_frame.node;
+		if(!_frame.held.empty()) dict->m_container.insert(std::move(_frame.held)); // its value was not reached
+		dict->settle(_frame.spare,_abort);
+	}
+	else if(!_abort) ((jsl_data_vect*)_frame.node)->settle(_frame.met,_frame.items);
+	_frame.reuse = false;
+}
 
-	switch(m_src.peek())
+jsl_data* jsl_parser::eat_scalar(int _c, jsl_data* _former)
+{
+	// a former scalar node takes the new string or number in place
+	jsl_data_scal* into = jsl_data::is_node(_former) && _former->type() < jsl_data::TYPE_DICT ? (jsl_data_scal*)_former : nullptr;
+
+	switch(_c)
 	{
 	case 'n': // null
 		return eat_null();
-	case 'f': // null
+	case 'f': // false
 		return eat_false();
-	case 't': // null
+	case 't': // true
 		return eat_true();
-	case '{': // dict
-		return eat_dict();
-	case '[': // vect
-		return eat_vect();
 	case '"': // string
-		return eat_str();
+		return eat_str(into);
 	// case '\'': // char
 	// 	return eat_chr();
 	case '0': // number
@@ -222,114 +858,356 @@ jsl_data* jsl_parser::eat_value()
 	case '9':
 	case '-':
 	case '.':
-		return eat_num();
+		return eat_num(into);
 
-	default: return nullptr; // invalid src
+	default:
+		fail_char();
+		return nullptr; // invalid src
 	}
 }
 
-jsl_data_scal* jsl_parser::eat_null()
+jsl_data* jsl_parser::eat_null()
 {
+	JSL_STAT(timer_t timer(m_lit_us));
+
 	if(eat_space())
 	{
 		ESP_LOGE(PARSER_LOGTAG, "Error : no food");
+		fail(jsl_error::ERROR_EOF);
 		return nullptr;
 	} // EOF
 
-	char buf[5] = {};
-	m_src.get(buf,5);
+	if(scan_lit("null"))
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : wrong null chars");
+		return nullptr;
+	}
 
-	if(
+	if(count_node()) return nullptr;
 
-		buf[0] == 'n' &&
-		buf[1] == 'u' &&
-		buf[2] == 'l' &&
-		buf[3] == 'l'
+	return jsl_data::imm(jsl_data::TYPE_NULL);
+}
 
-	){
+jsl_data* jsl_parser::eat_false()
+{
+	JSL_STAT(timer_t timer(m_lit_us));
 
-		return jsl_data_pool::hire_scal(); // defaults to nullptr
+	if(eat_space())
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : no food");
+		fail(jsl_error::ERROR_EOF);
+		return nullptr;
+	} // EOF
 
+	if(scan_lit("false"))
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : wrong false chars");
+		return nullptr;
 	}
 
-	m_src.seekg(-4,std::istream::cur);
-
-	ESP_LOGE(PARSER_LOGTAG, "Error : wrong null chars [%s]",buf);
-	return nullptr;
+	if(count_node()) return nullptr;
 
+	return jsl_data::imm(jsl_data::TYPE_BOOL,false);
 }
 
-jsl_data_scal* jsl_parser::eat_false()
+jsl_data* jsl_parser::eat_true()
 {
+	JSL_STAT(timer_t timer(m_lit_us));
+
 	if(eat_space())
 	{
 		ESP_LOGE(PARSER_LOGTAG, "Error : no food");
+		fail(jsl_error::ERROR_EOF);
 		return nullptr;
 	} // EOF
 
-	char buf[6] = {};
-	m_src.get(buf,6);
+	if(scan_lit("true"))
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : wrong true chars");
+		return nullptr;
+	}
+
+	if(count_node()) return nullptr;
 
-	if(
+	return jsl_data::imm(jsl_data::TYPE_BOOL,true);
+}
+
+jsl_data* jsl_parser::eat_num(jsl_data_scal* _into)
+{
+	JSL_STAT(timer_t timer(m_num_us));
+
+	if(eat_space())
+	{
+		ESP_LOGE(PARSER_LOGTAG, "Error : no food");
+		fail(jsl_error::ERROR_EOF);
+		return nullptr;
+	} // EOF
 
-		buf[0] == 'f' &&
-		buf[1] == 'a' &&
-		buf[2] == 'l' &&
-		buf[3] == 's' &&
-		buf[4] == 'e'
+	std::string& str = m_scratch;
+	str.clear();
+	bool intg = false;
+	if(scan_num(str,intg)) return nullptr;
 
-	){
+	if(_into == nullptr && count_node()) return nullptr;
 
-		return jsl_data_pool::hire(1 == 2); // false
+	if(intg)
+	{
+		long num = std::strtol(str.c_str(),nullptr,10); // clamped on overflow
+		if(num >= jsl_data::IMM_MIN && num <= jsl_data::IMM_MAX) return jsl_data::imm(jsl_data::TYPE_INT,num);
+	}
 
+	if(_into != nullptr)
+	{
+		if(intg)
+		{
+			long long num = std::strtoll(str.c_str(),nullptr,10);
+			int32_t val = num < INT32_MIN ? INT32_MIN : num > INT32_MAX ? INT32_MAX : (int32_t)num;
+			if(!(*_into == val)) *_into = val;
+		}
+		else
+		{
+			double val = std::strtod(str.c_str(),nullptr);
+			if(!(*_into == val)) *_into = val;
+		}
+		return _into;
 	}
 
-	m_src.seekg(-5,std::istream::cur);
+	jsl_data_scal* scal = nullptr;
 
-	ESP_LOGE(PARSER_LOGTAG, "Error : wrong false chars [%s]",buf);
-	return nullptr;
+	if(intg)
+	{
+		int32_t num = 0;
+		scal = jsl_data_pool::hire(num);
+		if(scal != nullptr) scal->from_string(str);
+	}
+	else
+	{
+		double num = 0;
+		scal = jsl_data_pool::hire(num);
+		if(scal != nullptr) scal->from_string(str);
+	}
 
+	if(scal == nullptr) fail(jsl_error::ERROR_POOL);
+	return scal;
 }
 
-jsl_data_scal* jsl_parser::eat_true()
+bool jsl_parser::eat_packed(jsl_data_vect& _vect)
 {
-	if(eat_space())
+	JSL_STAT(timer_t timer(m_num_us));
+
+	std::string& str = m_scratch;
+	str.clear();
+	bool intg = false;
+	if(scan_num(str,intg)) return true;
+
+	if(count_node()) return true;
+
+	if(intg)
 	{
-		ESP_LOGE(PARSER_LOGTAG, "Error : no food");
-		return nullptr;
-	} // EOF
+		long long num = std::strtoll(str.c_str(),nullptr,10); // clamped to int32, as a scalar int
+		return !_vect.push_int(num < INT32_MIN ? INT32_MIN : num > INT32_MAX ? INT32_MAX : (int32_t)num);
+	}
+	return !_vect.push_real(std::strtod(str.c_str(),nullptr));
+}
+
+// Sources for skip_json : a memory range or a generic stream
 
-	char buf[5] = {};
-	m_src.get(buf,5);
+struct jsl_parser::mem_cursor
+{
+	const char* p;
+	const char* end;
 
-	if(
+	inline int peek() const { return p != end ? (uint8_t)*p : std::istream::traits_type::eof(); }
+	inline void get() { ++p; }
+	inline bool str() // on the opening quote, false on EOF
+	{
+		p = skip_raw_str(p + 1,end);
+		if(p != nullptr) return true;
+		p = end;
+		return false;
+	}
+};
 
-		buf[0] == 't' &&
-		buf[1] == 'r' &&
-		buf[2] == 'u' &&
-		buf[3] == 'e'
+struct jsl_parser::stream_cursor
+{
+	std::istream& src;
 
-	){
+	inline int peek() { return src.peek(); }
+	inline void get() { src.get(); }
+	bool str()
+	{
+		const int eof = std::istream::traits_type::eof();
+		src.get();
+		for(int c; (c = src.get()) != eof;)
+		{
+			if(c == '"') return true;
+			if(c == '\\' && src.get() == eof) break;
+		}
+		return false;
+	}
+};
 
-		return jsl_data_pool::hire(1 == 1); // true
+template<typename cursor_t>
+bool jsl_parser::skip_json(cursor_t& _src, char _open)
+{
+	const int eof = std::istream::traits_type::eof();
+	auto digits = [&]() -> bool // one or more
+	{
+		int c = _src.peek();
+		if(c < '0' || c > '9') return false;
+		do { _src.get(); c = _src.peek(); } while(c >= '0' && c <= '9');
+		return true;
+	};
+	auto word = [&](const char* _lit) -> bool
+	{
+		for(; *_lit != '\0'; ++_lit, _src.get()) if(_src.peek() != *_lit) return false;
+		return true;
+	};
 
+	// what may come next, the closers of the open brackets tell dicts from vects
+	enum { VALUE, VALUE_OR_CLOSE, KEY, KEY_OR_CLOSE, COLON, NEXT } expect = VALUE;
+	std::vector<char> closers;
+	if(_open != 0)
+	{
+		closers.push_back(_open == '{' ? '}' : ']');
+		expect = _open == '{' ? KEY_OR_CLOSE : VALUE_OR_CLOSE;
 	}
 
-	m_src.seekg(-4,std::istream::cur);
+	for(;;)
+	{
+		int c = _src.peek();
+		if(c == eof) return false;
+		if(is_space(c))
+		{
+			_src.get();
+			continue;
+		}
+
+		switch(expect)
+		{
+		case KEY_OR_CLOSE:
+			if(c == '}') break;
+			// fall through
+		case KEY:
+			if(c != '"' || !_src.str()) return false;
+			expect = COLON;
+			continue;
+		case COLON:
+			if(c != ':') return false;
+			_src.get();
+			expect = VALUE;
+			continue;
+		case NEXT:
+			if(c == ',')
+			{
+				_src.get();
+				expect = closers.back() == '}' ? KEY : VALUE;
+				continue;
+			}
+			if(c != closers.back()) return false;
+			break;
+		case VALUE_OR_CLOSE:
+			if(c == ']') break;
+			// fall through
+		case VALUE:
+			if(c == '{' || c == '[')
+			{
+				_src.get();
+				closers.push_back(c == '{' ? '}' : ']');
+				expect = c == '{' ? KEY_OR_CLOSE : VALUE_OR_CLOSE;
+				continue;
+			}
+			if(c == '"')
+			{
+				if(!_src.str()) return false;
+			}
+			else if(c == '-' || (c >= '0' && c <= '9'))
+			{
+				// -?(?:0|[1-9]\d*)(?:\.\d+)?(?:[eE][+-]?\d+)?
+				if(c == '-') _src.get();
+				if(_src.peek() == '0') _src.get();
+				else if(!digits()) return false;
+				if(_src.peek() == '.')
+				{
+					_src.get();
+					if(!digits()) return false;
+				}
+				if(_src.peek() == 'e' || _src.peek() == 'E')
+				{
+					_src.get();
+					if(_src.peek() == '+' || _src.peek() == '-') _src.get();
+					if(!digits()) return false;
+				}
+			}
+			else if(!word(c == 't' ? "true" : c == 'f' ? "false" : "null")) return false;
 
-	ESP_LOGE(PARSER_LOGTAG, "Error : wrong true chars [%s]",buf);
-	return nullptr;
+			if(closers.empty()) return true; // a scalar value
+			expect = NEXT;
+			continue;
+		}
 
+		// the closer of the innermost container
+		_src.get();
+		closers.pop_back();
+		if(closers.empty()) return true;
+		expect = NEXT;
+	}
 }
 
-jsl_data_scal* jsl_parser::eat_num()
+bool jsl_parser::skip_value(char _open)
 {
-	if(eat_space())
+	if(m_mem != nullptr)
 	{
-		ESP_LOGE(PARSER_LOGTAG, "Error : no food");
-		return nullptr;
-	} // EOF
+		mem_cursor src = { m_mem->cur(), m_mem->end() };
+		bool ok = skip_json(src,_open);
+		m_mem->seek(src.p); // past the value, or on the faulty char
+		if(ok) return false;
+	}
+	else
+	{
+		stream_cursor src = { m_src };
+		if(skip_json(src,_open)) return false;
+	}
+
+	ESP_LOGE(PARSER_LOGTAG, "Error : skip_value, bad json");
+	fail_char();
+	return true;
+}
+
+const char* jsl_parser::skip_raw_str(const char* _p, const char* _end)
+{
+	while(_p != _end)
+	{
+		// memchr is about as fast as the libc gets (vectorized on hosts)
+		const char* q = (const char*)std::memchr(_p,'"',_end - _p);
+		if(q == nullptr) return nullptr;
+
+		// an odd run of backslashes escapes the quote
+		const char* b = q;
+		while(*(b - 1) == '\\') --b;
+		if(((q - b) & 1) == 0) return q + 1;
+
+		_p = q + 1;
+	}
+	return nullptr;
+}
+
+bool jsl_parser::scan_lit(const char* _lit)
+{
+	size_t len = std::strlen(_lit);
+	char buf[8] = {};
+	m_src.read(buf,len);
+
+	if(std::strncmp(buf,_lit,len) == 0) return false;
 
+	m_src.clear();
+	m_src.seekg(-m_src.gcount(),std::istream::cur);
+	fail(jsl_error::ERROR_LIT);
+	return true;
+}
+
+bool jsl_parser::scan_num(std::string& _str, bool& _intg)
+{
 	typedef enum
 	{
 		STATE_START,
@@ -342,13 +1220,13 @@ jsl_data_scal* jsl_parser::eat_num()
 		STATE_EXPO
 	} num_state_t;
 
-	std::string str;
 	num_state_t st = STATE_START;
 
 	while(!m_src.eof())
 	{
-		uint8_t p = m_src.peek();
-		if(is_space(p) || p == ',') break; // end of number
+		int p = m_src.peek();
+		if(p == std::istream::traits_type::eof()) break; // end of source
+		if(is_space(p) || p == ',' || p == ']' || p == '}') break; // end of number
 
 		// validate number
 		switch(p)
@@ -358,7 +1236,8 @@ jsl_data_scal* jsl_parser::eat_num()
 			if(st != STATE_START && st != STATE_EXPOS)
 			{
 				ESP_LOGE(PARSER_LOGTAG, "Error : illegal num state [-] : %d",st);
-				return nullptr;
+				fail(jsl_error::ERROR_NUM);
+				return true;
 			}
 			// set new state depending on source
 			if(st == STATE_EXPOS) st = STATE_EXPO;
@@ -369,7 +1248,8 @@ jsl_data_scal* jsl_parser::eat_num()
 			if(st != STATE_ZERO && st != STATE_INTG)
 			{
 				ESP_LOGE(PARSER_LOGTAG, "Error : illegal num state [.] : %d",st);
-				return nullptr;
+				fail(jsl_error::ERROR_NUM);
+				return true;
 			}
 			// set new state depending on source
 			st = STATE_REALS;
@@ -380,7 +1260,8 @@ jsl_data_scal* jsl_parser::eat_num()
 			if(st != STATE_INTG && st != STATE_REAL)
 			{
 				ESP_LOGE(PARSER_LOGTAG, "Error : illegal num state [E] : %d",st);
-				return nullptr;
+				fail(jsl_error::ERROR_NUM);
+				return true;
 			}
 			// set new state depending on source
 			st = STATE_EXPOS;
@@ -390,7 +1271,8 @@ jsl_data_scal* jsl_parser::eat_num()
 			if(st != STATE_EXPOS)
 			{
 				ESP_LOGE(PARSER_LOGTAG, "Error : illegal num state [+] : %d",st);
-				return nullptr;
+				fail(jsl_error::ERROR_NUM);
+				return true;
 			}
 			// set new state depending on source
 			st = STATE_EXPO;
@@ -400,7 +1282,8 @@ jsl_data_scal* jsl_parser::eat_num()
 			if(st != STATE_START && st != STATE_SIGN && st != STATE_INTG && st != STATE_REALS && st != STATE_REAL && st != STATE_EXPOS && st != STATE_EXPO)
 			{
 				ESP_LOGE(PARSER_LOGTAG, "Error : illegal num state [0] : %d",st);
-				return nullptr;
+				fail(jsl_error::ERROR_NUM);
+				return true;
 			}
 			// set new state depending on source
 			if(st == STATE_START || st == STATE_SIGN) st = STATE_ZERO;
@@ -420,54 +1303,64 @@ jsl_data_scal* jsl_parser::eat_num()
 			if(st != STATE_START && st != STATE_SIGN && st != STATE_INTG && st != STATE_REALS && st != STATE_REAL && st != STATE_EXPOS && st != STATE_EXPO)
 			{
 				ESP_LOGE(PARSER_LOGTAG, "Error : illegal num state [digit] : %d",st);
-				return nullptr;
+				fail(jsl_error::ERROR_NUM);
+				return true;
 			}
 			// set new state depending on source
 			if(st == STATE_START || st == STATE_SIGN) st = STATE_INTG;
 			else if(st == STATE_REALS) st = STATE_REAL;
 			else if(st == STATE_EXPOS) st = STATE_EXPO;
 			break;
-		default: return nullptr; // invalid src
+		default:
+			fail(jsl_error::ERROR_NUM);
+			return true; // invalid src
 		}
 
 		// eat stream
-		str.push_back(m_src.get());
+		_str.push_back(m_src.get());
 	}
 
 	if(st != STATE_ZERO && st != STATE_INTG && st != STATE_REAL && st != STATE_EXPO)
 	{
 		ESP_LOGE(PARSER_LOGTAG, "Error : illegal num state [end] : %d",st);
-		return nullptr;
-	}
-
-	jsl_data_scal* scal = nullptr;
-
-	if(st == STATE_INTG)
-	{
-		int32_t num = 0;
-		scal = jsl_data_pool::hire(num);
-		if(scal != nullptr) scal->from_string(str);
-	}
-	else
-	{
-		double num = 0;
-		scal = jsl_data_pool::hire(num);
-		if(scal != nullptr) scal->from_string(str);
+		fail(jsl_error::ERROR_NUM);
+		return true;
 	}
 
-	return scal;
+	_intg = (st == STATE_ZERO || st == STATE_INTG);
+	return false;
 }
 
-jsl_data_scal* jsl_parser::eat_str()
+jsl_data_scal* jsl_parser::eat_str(jsl_data_scal* _into)
 {
-	std::string str;
+	JSL_STAT(timer_t timer(m_str_us));
+
+	std::string& str = m_scratch;
+	str.clear();
 	if(scan_str(str))
 	{
 		ESP_LOGE(PARSER_LOGTAG, "Error : unexpected EOF");
 		return nullptr;
 	} // EOF
 
-	return jsl_data_pool::hire(str);
+	if(_into != nullptr)
+	{
+		// same size class strings keep their bytes (see jsl_data_scal::assign)
+		if(!(*_into == str))
+		{
+			JSL_STAT(m_copied_bytes += str.size());
+			_into->assign(str.data(),str.size());
+		}
+		return _into;
+	}
+
+	JSL_STAT(m_copied_bytes += str.size());
+
+	if(count_node()) return nullptr;
+
+	jsl_data_scal* scal = jsl_data_pool::hire(str);
+	if(scal == nullptr) fail(jsl_error::ERROR_POOL);
+	return scal;
 }
 
 bool jsl_parser::scan_str(std::string& _str)
@@ -475,14 +1368,19 @@ bool jsl_parser::scan_str(std::string& _str)
 	if(m_src.peek() != '"')
 	{
 		ESP_LOGE(PARSER_LOGTAG, "Error : wrong init char [%c]",m_src.peek());
+		fail_char();
 		return true;
 	}
 
 	m_src.get();
 
+	if(m_mem != nullptr) return scan_raw_str(_str);
+
+	// generic stream, byte by byte
 	while(!m_src.eof())
 	{
-		switch(m_src.peek())
+		int c = m_src.peek();
+		switch(c)
 		{
 		case '"': // end
 			m_src.get();
@@ -491,23 +1389,123 @@ bool jsl_parser::scan_str(std::string& _str)
 			if(unescape(_str)) return true;
 			break;
 		default:
-			_str.push_back(m_src.get());
+			if(c < 0x80 || !m_limits.utf8)
+			{
+				_str.push_back(m_src.get());
+				break;
+			}
+			{
+				// a whole sequence, checked before it goes in
+				uint8_t seq[4] = { (uint8_t)m_src.get() };
+				size_t size = seq[0] >= 0xf0 ? 4 : seq[0] >= 0xe0 ? 3 : 2;
+				for(size_t i = 1; i < size && (m_src.peek() & 0xc0) == 0x80; ++i) seq[i] = m_src.get();
+				if(utf8_len(seq,size) != size)
+				{
+					ESP_LOGE(PARSER_LOGTAG, "Error : invalid UTF-8");
+					fail(jsl_error::ERROR_STR);
+					return true;
+				}
+				_str.append((const char*)seq,size);
+			}
+		}
+
+		if(_str.size() > m_limits.str)
+		{
+			ESP_LOGE(PARSER_LOGTAG, "Error : str limit");
+			fail(jsl_error::ERROR_LIMIT);
+			return true;
 		}
 	}
 
+	fail(jsl_error::ERROR_EOF);
 	return true; // unexpected EOF
 }
 
+bool jsl_parser::scan_raw_str(std::string& _str)
+{
+	// Plain ASCII runs are found a word at a time (SWAR : 4 bytes on esp32,
+	// 8 on hosts) and appended whole, the loop only stops on a quote, a
+	// backslash or a non-ASCII byte, whose sequence is checked in place.
+	typedef uintptr_t word_t;
+	const word_t ones = ~(word_t)0 / 0xff;
+	const word_t highs = ones * 0x80;
+	auto special = [&](word_t _w) -> word_t
+	{
+		word_t quote = _w ^ (ones * '"');
+		word_t slash = _w ^ (ones * '\\');
+		return (((quote - ones) & ~quote) | ((slash - ones) & ~slash) | _w) & highs;
+	};
+
+	const char* p = m_mem->cur();
+	const char* end = m_mem->end();
+
+	while(true)
+	{
+		const char* run = p;
+		word_t w;
+		while((size_t)(end - p) >= sizeof(word_t))
+		{
+			std::memcpy(&w,p,sizeof(word_t)); // unaligned load
+			if(special(w) != 0) break;
+			p += sizeof(word_t);
+		}
+		while(p != end && *p != '"' && *p != '\\' && (uint8_t)*p < 0x80) ++p;
+		_str.append(run,p - run);
+
+		if(_str.size() > m_limits.str)
+		{
+			ESP_LOGE(PARSER_LOGTAG, "Error : str limit");
+			m_mem->seek(p);
+			fail(jsl_error::ERROR_LIMIT);
+			return true;
+		}
+
+		if(p == end)
+		{
+			m_mem->seek(p);
+			fail(jsl_error::ERROR_EOF);
+			return true; // unexpected EOF
+		}
+
+		if(*p == '"') // end
+		{
+			m_mem->seek(p + 1);
+			return false;
+		}
+
+		if(*p == '\\') // unescape
+		{
+			m_mem->seek(p);
+			if(unescape(_str)) return true;
+			p = m_mem->cur();
+			continue;
+		}
+
+		size_t size = m_limits.utf8 ? utf8_len((const uint8_t*)p,end - p) : 1;
+		if(size == 0)
+		{
+			ESP_LOGE(PARSER_LOGTAG, "Error : invalid UTF-8");
+			m_mem->seek(p);
+			fail(jsl_error::ERROR_STR);
+			return true;
+		}
+		_str.append(p,size);
+		p += size;
+	}
+}
+
 bool jsl_parser::unescape(std::string& _str)
 {
 	if(m_src.peek() != '\\')
 	{
 		ESP_LOGE(PARSER_LOGTAG, "Error : wrong init char [%c]",m_src.peek());
+		fail_char();
 		return true;
 	}
 
 	m_src.get();
 
+escaped:
 	switch(m_src.peek())
 	{
 	case '"':
@@ -535,71 +1533,149 @@ bool jsl_parser::unescape(std::string& _str)
 		_str.push_back('\t');
 		m_src.get();
 		break;
-	case 'u':
+	case 'u': {
 		m_src.get();
 
-		char buf[5] = {};
-		m_src.get(buf,4);
-		std::string::value_type ch = std::strtol(buf,nullptr,16);
-		utf8_str(ch,_str);
+		uint32_t code;
+		if(eat_hex4(code)) return true;
+
+		if(code >= 0xd800 && code <= 0xdbff && m_src.peek() == '\\')
+		{
+			// high surrogate, the low half comes as a second escape
+			m_src.get();
+			if(m_src.peek() != 'u' && !m_limits.utf8)
+			{
+				utf8_str(0xfffd,_str); // lone, the escape after it reads as usual
+				goto escaped;
+			}
+			uint32_t low;
+			if(m_src.get() != 'u' || eat_hex4(low))
+			{
+				ESP_LOGE(PARSER_LOGTAG, "Error : bad surrogate pair");
+				fail(jsl_error::ERROR_STR);
+				return true;
+			}
+			if(low >= 0xdc00 && low <= 0xdfff) code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+			else if(m_limits.utf8)
+			{
+				ESP_LOGE(PARSER_LOGTAG, "Error : bad surrogate pair");
+				fail(jsl_error::ERROR_STR);
+				return true;
+			}
+			else
+			{
+				utf8_str(0xfffd,_str);
+				code = low;
+			}
+		}
+
+		if(code >= 0xd800 && code <= 0xdfff)
+		{
+			// lone surrogate, no UTF-8 for it
+			if(m_limits.utf8)
+			{
+				ESP_LOGE(PARSER_LOGTAG, "Error : lone surrogate");
+				fail(jsl_error::ERROR_STR);
+				return true;
+			}
+			code = 0xfffd;
+		}
+
+		utf8_str(code,_str);
 		break;
 	}
+	default:
+		ESP_LOGE(PARSER_LOGTAG, "Error : wrong escape char [%c]",m_src.peek());
+		fail(jsl_error::ERROR_STR);
+		return true;
+	}
+
+	return false;
+}
+
+bool jsl_parser::eat_hex4(uint32_t& _code)
+{
+	static const struct hex_table
+	{
+		uint8_t t[256];
+		hex_table()
+		{
+			std::memset(t,0xff,sizeof(t));
+			for(int i = 0; i < 10; ++i) t['0' + i] = i;
+			for(int i = 0; i < 6; ++i) t['a' + i] = t['A' + i] = 10 + i;
+		}
+	} table;
 
+	_code = 0;
+	for(int i = 0; i < 4; ++i)
+	{
+		int c = m_src.peek();
+		uint8_t digit = c == std::istream::traits_type::eof() ? 0xff : table.t[(uint8_t)c];
+		if(digit == 0xff)
+		{
+			ESP_LOGE(PARSER_LOGTAG, "Error : bad \\u escape");
+			fail(c == std::istream::traits_type::eof() ? jsl_error::ERROR_EOF : jsl_error::ERROR_STR);
+			return true;
+		}
+		m_src.get();
+		_code = _code << 4 | digit;
+	}
 	return false;
 }
 
 void jsl_parser::utf8_str(uint32_t _char, std::string& _str)
 {
-	char buf[5] = {};
-	if (_char <= 0x7F)
+	if(_char <= 0x7f)
 	{
-		buf[0] = static_cast<char>(_char);
+		_str.push_back((char)_char); // \u0000 included
 	}
-	else if (_char <= 0x7FF)
+	else if(_char <= 0x7ff)
 	{
-		buf[1] = 0x80 | (_char & 0x3F);
-		_char >>= 6;
-		buf[0] = 0xC0 | _char;
+		_str.push_back((char)(0xc0 | (_char >> 6)));
+		_str.push_back((char)(0x80 | (_char & 0x3f)));
 	}
-	else if (_char <= 0xFFFF)
+	else if(_char <= 0xffff)
 	{
-		buf[2] = 0x80 | (_char & 0x3F);
-		_char >>= 6;
-		buf[1] = 0x80 | (_char & 0x3F);
-		_char >>= 6;
-		buf[0] = 0xE0 | _char;
+		_str.push_back((char)(0xe0 | (_char >> 12)));
+		_str.push_back((char)(0x80 | ((_char >> 6) & 0x3f)));
+		_str.push_back((char)(0x80 | (_char & 0x3f)));
 	}
 	else
 	{
-		buf[3] = 0x80 | (_char & 0x3F);
-		_char >>= 6;
-		buf[2] = 0x80 | (_char & 0x3F);
-		_char >>= 6;
-		buf[1] = 0x80 | (_char & 0x3F);
-		_char >>= 6;
-		buf[0] = 0xF0 | _char;
+		_str.push_back((char)(0xf0 | (_char >> 18)));
+		_str.push_back((char)(0x80 | ((_char >> 12) & 0x3f)));
+		_str.push_back((char)(0x80 | ((_char >> 6) & 0x3f)));
+		_str.push_back((char)(0x80 | (_char & 0x3f)));
 	}
-	_str += buf;
 }
 
-bool jsl_parser::is_space(uint8_t _c)
+size_t jsl_parser::utf8_len(const uint8_t* _p, size_t _size)
 {
-	return
-		(_c == '\f') |
-		(_c == '\b') |
-		(_c == '\n') |
-		(_c == '\r') |
-		(_c == '\t') |
-		(_c == ' ');
-}
+	// RFC 3629 : no overlong forms, no surrogates, nothing past U+10FFFF
+	uint8_t c = _p[0];
+	if(c < 0x80) return 1;
+
+	size_t size;
+	uint8_t low = 0x80, high = 0xbf; // range of the second byte
+	if(c >= 0xc2 && c <= 0xdf) size = 2;
+	else if(c >= 0xe0 && c <= 0xef)
+	{
+		size = 3;
+		if(c == 0xe0) low = 0xa0;
+		else if(c == 0xed) high = 0x9f;
+	}
+	else if(c >= 0xf0 && c <= 0xf4)
+	{
+		size = 4;
+		if(c == 0xf0) low = 0x90;
+		else if(c == 0xf4) high = 0x8f;
+	}
+	else return 0;
 
-bool jsl_parser::eat_space()
-{
-	while(is_space(m_src.peek()))
+	if(_size < size || _p[1] < low || _p[1] > high) return 0;
+	for(size_t i = 2; i < size; ++i)
 	{
-		m_src.get();
-		if(m_src.eof()) return true; // EOF
+		if((_p[i] & 0xc0) != 0x80) return 0;
 	}
-	return false; // not EOF
+	return size;
 }
-
@@ -28,8 +28,77 @@
 
 #include <string>
 #include <fstream>
+#include <vector>
+#include <set>
+#include <cstdint>
+#include <atomic>
 
 #include "jsl-data.h"
+#include "jsl-stream.h"
+
+#if JSL_STATS
+#include <chrono>
+#endif
+
+
+
+// Parse failure report, filled at the failing spot without any formatting
+
+struct jsl_error
+{
+	typedef enum {
+		ERROR_NONE,
+		ERROR_EOF, // unexpected end of source
+		ERROR_CHAR, // unexpected char
+		ERROR_NAME, // prop-name missing or doubled
+		ERROR_LIT, // bad null, true or false
+		ERROR_NUM, // bad number
+		ERROR_STR, // bad string or escape
+		ERROR_POOL, // pool exhausted
+		ERROR_FILE, // source file could not be read
+		ERROR_LIMIT // a jsl_limits bound was hit
+	} code_t;
+
+	code_t code;
+	size_t offset; // source byte offset
+	uint32_t line; // 1 based, 0 until located
+	uint32_t col; // 1 based, in bytes, 0 until located
+
+	jsl_error() :
+		code(ERROR_NONE),
+		offset(0),
+		line(0),
+		col(0)
+	{}
+
+	inline operator bool() const { return code != ERROR_NONE; }
+
+	const char* what() const;
+
+	// Computes line and col from the source the offset refers to
+	void locate(const char* _src, size_t _len);
+};
+
+
+
+// Bounds for untrusted sources, checked as the parse goes
+
+struct jsl_limits
+{
+	uint32_t depth; // nested dicts and vects
+	uint32_t str; // bytes in one string or prop-name
+	uint32_t items; // members of one dict or vect
+	uint32_t nodes; // nodes hired by one parse
+	bool utf8; // strings and \u escapes must be valid UTF-8 (ERROR_STR), off : bytes go through as they are
+
+	jsl_limits() :
+		depth(UINT32_MAX),
+		str(UINT32_MAX),
+		items(UINT32_MAX),
+		nodes(UINT32_MAX),
+		utf8(true)
+	{}
+};
 
 
 
@@ -39,31 +108,200 @@ public:
 
 	typedef std::istream& src_t;
 
-	jsl_parser(src_t& _src) : m_src(_src) {}
+	jsl_parser(src_t& _src) :
+		m_src(_src),
+		m_mem(nullptr),
+		m_limits(m_defaults),
+		m_depth(0),
+		m_nodes(0),
+		m_top(0)
+	{}
+
+	jsl_parser(jsl_memstream& _src) :
+		m_src(_src),
+		m_mem(&_src.buf()),
+		m_limits(m_defaults),
+		m_depth(0),
+		m_nodes(0),
+		m_top(0)
+	{}
 
 	jsl_data_dict* parse();
 
+	// Parses into a former tree instead of hiring a new one : nodes, strings and
+	// container capacity are kept wherever the shape matches, scalars only change
+	// (and invalidate the cached hashes and encodings) when their value does, and
+	// the pool is only reached for the differences. A same-shaped message then
+	// parses without allocating (keep the parser, reset its jsl_memstream).
+	// On failure _tree is left valid but partly updated.
+	bool reparse(jsl_data_dict& _tree);
+
+	// Parses a file straight from its read only mapping, no intermediate copy
+	static jsl_data_dict* parse_file(const char* _path, jsl_error* _error = nullptr);
+
+	// Last failure, error().code is ERROR_NONE after a successful parse
+	inline const jsl_error& error() const { return m_error; }
+
+	// Fills error() line and col, rescanning the source up to the failure
+	const jsl_error& locate();
+
+	// Pool and parser counters, all zero unless built with JSL_STATS
+	static jsl_stats stats();
+	static void reset_stats();
+
+	// Limits of this parser, initialized from defaults()
+	inline jsl_limits& limits() { return m_limits; }
+
+	// Limits given to new parsers, including the ones parse_file and parse_vect make
+	static inline jsl_limits& defaults() { return m_defaults; }
+
+	// Values of these keys are skipped, not built, wherever they appear
+	inline void ignore(const std::string& _key) { m_ignored.insert(_key); }
+
+	// Parses a top-level array, splitting its elements over _jobs threads
+	static jsl_data_vect* parse_vect(const char* _buf, size_t _len, uint8_t _jobs = 2, jsl_error* _error = nullptr);
+	static jsl_data_vect* parse_vect(const std::string& _src, uint8_t _jobs = 2, jsl_error* _error = nullptr)
+	{
+		return parse_vect(_src.data(),_src.size(),_jobs,_error);
+	}
+
 protected:
 
+	inline bool count_node() // returns true past the nodes limit
+	{
+		if(++m_nodes <= m_limits.nodes) return false;
+		fail(jsl_error::ERROR_LIMIT);
+		return true;
+	}
+
+	void fail(jsl_error::code_t _code); // keeps the first (innermost) failure
+	void fail_char(); // ERROR_CHAR, or ERROR_EOF when the source is exhausted
+
+	static bool split_vect(const char* _buf, size_t _len, uint8_t _jobs, std::vector<const char*>& _cuts, jsl_error& _error);
+	bool eat_items(jsl_data_vect& _items); // comma separated values up to EOF
+
+	typedef struct
+	{
+		jsl_data* node; // dict or vect being filled
+		char close; // its closing bracket
+		std::string name; // pending prop-name (dicts)
+		bool reuse; // node belongs to the tree being reparsed
+		jsl_data_dict::dict_t spare; // reused dict : former props not met yet
+		jsl_data_dict::dict_t::node_type held; // reused dict : former prop of the pending name
+		int32_t met; // reused vect : former items overwritten so far
+		int32_t items; // reused vect : count of former items
+		uint32_t path; // hash of the position in the document, see m_hints
+	} frame_t;
+
 	jsl_data_dict* eat_dict();
-	jsl_data_vect* eat_vect();
+	jsl_data* eat_value(bool _slot = false, jsl_data* _former = nullptr); // _slot : the caller stores it in a container, immediates are fine
+
+	frame_t* open(bool _dict, jsl_data* _former); // reuses _former when it has the right type
+	jsl_data* former_of(const frame_t& _frame) const; // slot of the value to come in a reused container
+	void settle(frame_t& _frame, bool _abort);
+	jsl_data* eat_scalar(int _c, jsl_data* _former = nullptr); // null, bools and small ints come as immediates (see jsl_data)
 
-	jsl_data* eat_value();
+	jsl_data* eat_null();
+	jsl_data* eat_false();
+	jsl_data* eat_true();
+	jsl_data* eat_num(jsl_data_scal* _into = nullptr); // _into is updated in place
+	bool eat_packed(jsl_data_vect& _vect); // a number into a packed vect, true on failure
+	jsl_data_scal* eat_str(jsl_data_scal* _into = nullptr);
 
-	jsl_data_scal* eat_null();
-	jsl_data_scal* eat_false();
-	jsl_data_scal* eat_true();
-	jsl_data_scal* eat_num();
-	jsl_data_scal* eat_str();
+	// Skipping checks the syntax as parsing does (matched brackets, tokens in
+	// place, literals and numbers well formed) but builds nothing and leaves
+	// the string contents unread
+	bool skip_value(char _open = 0); // returns true on error, _open : bracket of a container already entered
+	struct mem_cursor;
+	struct stream_cursor;
+	template<typename cursor_t> static bool skip_json(cursor_t& _src, char _open); // false on bad json, _src left on the faulty char
+	static const char* skip_raw_str(const char* _p, const char* _end); // past the closing quote
 
-	bool scan_str(std::string& _str); // returns true on EOF
+	bool scan_lit(const char* _lit); // returns true on mismatch
+	bool scan_num(std::string& _str, bool& _intg); // returns true on error
+	bool scan_str(std::string& _str); // returns true on EOF or a bad string
+	bool scan_raw_str(std::string& _str); // scan_str over a memory source, a word at a time
 	bool unescape(std::string& _str); //
-	void utf8_str(uint32_t _char, std::string& _str);
+	bool eat_hex4(uint32_t& _code); // the 4 hex digits of a \u escape, true on error
+	static void utf8_str(uint32_t _char, std::string& _str);
+	static size_t utf8_len(const uint8_t* _p, size_t _size); // of a valid sequence at _p, 0 if invalid
 
-	inline bool is_space(uint8_t _c);
-	inline bool eat_space(); // returns true on EOF
+	static inline bool is_space(uint8_t _c)
+	{
+		return
+			(_c == '\f') |
+			(_c == '\b') |
+			(_c == '\n') |
+			(_c == '\r') |
+			(_c == '\t') |
+			(_c == ' ');
+	}
+
+	inline bool eat_space() // returns true on EOF
+	{
+		while(is_space(m_src.peek()))
+		{
+			m_src.get();
+			if(m_src.eof()) return true; // EOF
+		}
+		return false; // not EOF
+	}
 
 	const src_t m_src;
+	jsl_membuf* m_mem; // set when the source is contiguous memory
+
+	std::set<std::string> m_ignored;
+
+	jsl_error m_error;
+
+	static jsl_limits m_defaults;
+	jsl_limits m_limits;
+	uint32_t m_depth;
+	uint32_t m_nodes;
+
+	std::vector<frame_t> m_stack; // open containers, grows up to the depth limit
+	size_t m_top; // frames in use
+
+	std::string m_scratch; // numbers and strings are scanned here, keeps its capacity
+
+	// Size hints : the item count last seen at a position of the document
+	// (hash of the prop-names leading there, vect items sharing one), so a
+	// vect is hired with the room it will need (count << 2 | real << 1 | packed). Shared
+	// by every parser and direct mapped, a collision only costs a wrong guess.
+	enum {
+		HINTS = 64,
+		HINT_MAX = 1024 // items, past that a guess costs more than the regrowth
+	};
+	static std::atomic<uint32_t> m_hints[HINTS];
+
+#if JSL_STATS
+	typedef std::atomic<uint64_t> counter_t; // parse_vect runs several parsers at once
+
+	static counter_t m_parsed_bytes;
+	static counter_t m_copied_bytes;
+	static counter_t m_parse_us;
+	static counter_t m_num_us;
+	static counter_t m_str_us;
+	static counter_t m_lit_us;
+
+	class timer_t
+	{
+	public:
+		timer_t(counter_t& _us) :
+			m_us(_us),
+			m_start(std::chrono::steady_clock::now())
+		{}
+		~timer_t()
+		{
+			m_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+		}
+	protected:
+		counter_t& m_us;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	void count_parsed();
+#endif
 };
 
 #endif // #ifndef JSL_PARSER_H
@@ -0,0 +1,623 @@
+/*
+	jsl-patch.cpp
+
+	This scource file is part of the jsl-esp32 project.
+
+	Author: Lorenzo Pastrana
+	Copyright © 2019 Lorenzo Pastrana
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your
+	option) any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+	for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+
+#include <utility>
+
+#define LOG_LOCAL_LEVEL ESP_LOG_NONE
+// #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+constexpr char PATCH_LOGTAG[] = "PATCH :";
+#include <esp_log.h>
+
+#include "jsl-patch.h"
+
+
+
+const char* jsl_patch::what(result_t _result)
+{
+	switch(_result)
+	{
+	case PATCH_OK: return "no error";
+	case PATCH_OP: return "malformed operation";
+	case PATCH_PATH: return "unresolved path";
+	case PATCH_TEST: return "test failed";
+	case PATCH_POOL: return "pool exhausted";
+	}
+	return "unknown error";
+}
+
+jsl_patch::result_t jsl_patch::apply(jsl_data_dict& _doc, jsl_data_vect& _patch, int32_t* _failed)
+{
+	result_t result = PATCH_OK;
+	int32_t i = 0;
+
+	for(; i < _patch.size(); ++i)
+	{
+		jsl_data_dict* op = nullptr;
+		std::string name, pointer;
+		path_t path;
+
+		if(!_patch.get(i,op) || !op->get("op",name) || !op->get("path",pointer))
+		{
+			ESP_LOGE(PATCH_LOGTAG, "Error : malformed operation %d", i);
+			result = PATCH_OP;
+			break;
+		}
+		if(!split(pointer.c_str(),path))
+		{
+			ESP_LOGE(PATCH_LOGTAG, "Error : bad pointer %s", pointer.c_str());
+			result = PATCH_PATH;
+			break;
+		}
+
+		if(name == "add" || name == "replace" || name == "test")
+		{
+			auto value = op->find("value");
+			if(value == op->end() || value->second == nullptr)
+			{
+				ESP_LOGE(PATCH_LOGTAG, "Error : %s without value", name.c_str());
+				result = PATCH_OP;
+				break;
+			}
+
+			if(name == "test")
+			{
+				jsl_data_scal scratch;
+				const jsl_data* target = walk(_doc,path,path.size(),scratch);
+				if(target == nullptr) result = PATCH_PATH;
+				else if(*target != *value->second) result = PATCH_TEST;
+				if(result != PATCH_OK) break;
+				continue;
+			}
+
+			jsl_data* copy = jsl_data_pool::clone(*value->second);
+			if(copy == nullptr)
+			{
+				result = PATCH_POOL;
+				break;
+			}
+			if(name == "replace" && !path.empty())
+			{
+				result = remove(_doc,path,nullptr);
+				if(result != PATCH_OK)
+				{
+					ESP_LOGE(PATCH_LOGTAG, "Error : nothing to replace at %s", pointer.c_str());
+					copy->fire();
+					break;
+				}
+			}
+			result = add(_doc,path,*copy);
+			if(result != PATCH_OK)
+			{
+				copy->fire();
+				break;
+			}
+		}
+		else if(name == "remove")
+		{
+			result = remove(_doc,path,nullptr);
+			if(result != PATCH_OK) break;
+		}
+		else if(name == "move" || name == "copy")
+		{
+			std::string source;
+			path_t from;
+			if(!op->get("from",source) || !split(source.c_str(),from))
+			{
+				ESP_LOGE(PATCH_LOGTAG, "Error : %s without from", name.c_str());
+				result = PATCH_OP;
+				break;
+			}
+
+			jsl_data* node = nullptr;
+			if(name == "move")
+			{
+				if(source == pointer) continue;
+				if(pointer.compare(0,source.size() + 1,source + "/") == 0)
+				{
+					ESP_LOGE(PATCH_LOGTAG, "Error : move into itself");
+					result = PATCH_PATH;
+					break;
+				}
+				result = remove(_doc,from,&node);
+				if(result != PATCH_OK) break;
+			}
+			else
+			{
+				jsl_data_scal scratch;
+				const jsl_data* target = walk(_doc,from,from.size(),scratch);
+				if(target == nullptr)
+				{
+					result = PATCH_PATH;
+					break;
+				}
+				node = jsl_data_pool::clone(*target);
+				if(node == nullptr)
+				{
+					result = PATCH_POOL;
+					break;
+				}
+			}
+
+			result = add(_doc,path,*node);
+			if(result != PATCH_OK)
+			{
+				// a moved node goes back where it was taken from
+				if(name != "move" || add(_doc,from,*node) != PATCH_OK) node->fire();
+				break;
+			}
+		}
+		else
+		{
+			ESP_LOGE(PATCH_LOGTAG, "Error : unknown op %s", name.c_str());
+			result = PATCH_OP;
+			break;
+		}
+	}
+
+	if(_failed != nullptr) *_failed = result == PATCH_OK ? -1 : i;
+	return result;
+}
+
+jsl_patch::result_t jsl_patch::merge(jsl_data_dict& _doc, jsl_data_dict& _patch)
+{
+	// Explicit stack of (target, patch) dicts, the patch depth bounds it
+	std::vector<std::pair<jsl_data_dict*,jsl_data_dict*>> stack(1,{ &_doc, &_patch });
+
+	while(!stack.empty())
+	{
+		jsl_data_dict& target = *stack.back().first;
+		jsl_data_dict& patch = *stack.back().second;
+		stack.pop_back();
+
+		// the patch slots are read as they are, nothing is materialized in it
+		for(auto prop = patch.m_container.begin(); prop != patch.m_container.end(); ++prop)
+		{
+			const char* key = prop->first.c_str();
+			jsl_data* value = prop->second;
+
+			if(value == nullptr || jsl_data::type_of(value) == jsl_data::TYPE_NULL)
+			{
+				target.erase(key);
+				continue;
+			}
+
+			if(jsl_data::type_of(value) == jsl_data::TYPE_DICT)
+			{
+				jsl_data_dict* child = nullptr;
+				if(!target.get(key,child))
+				{
+					child = jsl_data_pool::hire_dict();
+					if(child == nullptr) return PATCH_POOL;
+					jsl_data* former = target.set_prop(key,*child);
+					if(former != nullptr) former->fire();
+				}
+				stack.push_back({ child, (jsl_data_dict*)value });
+				continue;
+			}
+
+			jsl_data* slot = copy(value);
+			if(slot == nullptr) return PATCH_POOL;
+			jsl_data* former = target.put(key,slot);
+			if(jsl_data::is_node(former)) former->fire();
+		}
+	}
+
+	return PATCH_OK;
+}
+
+jsl_data_vect* jsl_patch::diff(jsl_data_dict& _from, jsl_data_dict& _to)
+{
+	jsl_data_vect* ops = jsl_data_pool::hire_vect();
+	if(ops == nullptr) return nullptr;
+
+	typedef struct
+	{
+		const jsl_data* from;
+		const jsl_data* to;
+		std::string path;
+	} pair_t;
+
+	// Both trees are read in place : immediates are loaded into scratch
+	// nodes, so a pair is settled at once unless it holds two containers of
+	// a kind, which are walked later. Ops only ever touch their own subtree,
+	// or the vect slots past the ones paired below them, so the stack order
+	// is safe to apply
+	std::vector<pair_t> stack;
+	jsl_data_scal sf, st;
+	auto step = [&](const jsl_data* _f, const jsl_data* _t, std::string&& _path) -> bool
+	{
+		if(_f == nullptr || _t == nullptr) return false; // no_node, the pool ran out
+		if(same(_f,_t)) return true;
+		jsl_data::node_type_t type = _f->type();
+		if(type == _t->type() && (type == jsl_data::TYPE_DICT || type == jsl_data::TYPE_VECT))
+		{
+			stack.push_back({ _f, _t, std::move(_path) });
+			return true;
+		}
+		return emit(*ops,"replace",_path,_t);
+	};
+
+	if(!step(&_from,&_to,"")) goto abort;
+	while(!stack.empty())
+	{
+		pair_t pair = std::move(stack.back());
+		stack.pop_back();
+
+		if(pair.from->type() == jsl_data::TYPE_DICT)
+		{
+			// both maps are sorted : a single merge walk
+			const jsl_data_dict::dict_t& from = ((const jsl_data_dict*)pair.from)->m_container;
+			const jsl_data_dict::dict_t& to = ((const jsl_data_dict*)pair.to)->m_container;
+			auto pf = from.begin();
+			auto pt = to.begin();
+			while(pf != from.end() || pt != to.end())
+			{
+				if(pt == to.end() || (pf != from.end() && pf->first < pt->first))
+				{
+					if(!emit(*ops,"remove",pair.path + "/" + escape(pf->first),nullptr)) goto abort;
+					++pf;
+				}
+				else if(pf == from.end() || pt->first < pf->first)
+				{
+					if(!emit(*ops,"add",pair.path + "/" + escape(pt->first),jsl_data::peek(pt->second,st))) goto abort;
+					++pt;
+				}
+				else
+				{
+					if(!step(jsl_data::peek(pf->second,sf),jsl_data::peek(pt->second,st),pair.path + "/" + escape(pf->first))) goto abort;
+					++pf;
+					++pt;
+				}
+			}
+			continue;
+		}
+
+		// two vects, packed ones read straight from their array
+		const jsl_data_vect& from = *(const jsl_data_vect*)pair.from;
+		const jsl_data_vect& to = *(const jsl_data_vect*)pair.to;
+		int32_t from_size = from.size();
+		int32_t to_size = to.size();
+
+		int32_t head = 0;
+		while(head < from_size && head < to_size && same(from.peek(head,sf),to.peek(head,st))) ++head;
+		int32_t tail = 0;
+		while(
+			tail < from_size - head && tail < to_size - head &&
+			same(from.peek(from_size - 1 - tail,sf),to.peek(to_size - 1 - tail,st))
+		) ++tail;
+
+		int32_t from_mid = from_size - head - tail;
+		int32_t to_mid = to_size - head - tail;
+		int32_t paired = from_mid < to_mid ? from_mid : to_mid;
+
+		for(int32_t i = 0; i < paired; ++i)
+		{
+			if(!step(from.peek(head + i,sf),to.peek(head + i,st),pair.path + "/" + std::to_string(head + i))) goto abort;
+		}
+		for(int32_t i = from_mid - 1; i >= paired; --i) // backwards, the indices hold
+		{
+			if(!emit(*ops,"remove",pair.path + "/" + std::to_string(head + i),nullptr)) goto abort;
+		}
+		for(int32_t i = paired; i < to_mid; ++i)
+		{
+			if(!emit(*ops,"add",pair.path + "/" + std::to_string(head + i),to.peek(head + i,st))) goto abort;
+		}
+	}
+
+	return ops;
+
+abort:
+
+	ESP_LOGE(PATCH_LOGTAG, "Error : pool exhausted");
+	ops->fire();
+	return nullptr;
+}
+
+jsl_data_dict* jsl_patch::merge_diff(jsl_data_dict& _from, jsl_data_dict& _to)
+{
+	jsl_data_dict* patch = jsl_data_pool::hire_dict();
+	if(patch == nullptr) return nullptr;
+
+	typedef struct
+	{
+		const jsl_data_dict* from;
+		const jsl_data_dict* to;
+		jsl_data_dict* patch;
+	} triple_t;
+
+	// read in place as diff does, immediates go into the patch as they are
+	std::vector<triple_t> stack(1,{ &_from, &_to, patch });
+	jsl_data_scal sf, st;
+	while(!stack.empty())
+	{
+		triple_t triple = stack.back();
+		stack.pop_back();
+
+		const jsl_data_dict::dict_t& from = triple.from->m_container;
+		const jsl_data_dict::dict_t& to = triple.to->m_container;
+		auto pf = from.begin();
+		auto pt = to.begin();
+		while(pf != from.end() || pt != to.end())
+		{
+			jsl_data* value = nullptr;
+			const std::string* key;
+
+			if(pt == to.end() || (pf != from.end() && pf->first < pt->first))
+			{
+				key = &pf->first;
+				value = jsl_data::imm(jsl_data::TYPE_NULL); // removed
+				++pf;
+			}
+			else if(pf == from.end() || pt->first < pf->first)
+			{
+				key = &pt->first;
+				value = copy(pt->second);
+				++pt;
+			}
+			else
+			{
+				key = &pt->first;
+				const jsl_data* f = jsl_data::peek(pf->second,sf);
+				const jsl_data* t = jsl_data::peek(pt->second,st);
+				jsl_data* slot = pt->second;
+				++pf;
+				++pt;
+				if(same(f,t)) continue;
+				if(f->type() == jsl_data::TYPE_DICT && t->type() == jsl_data::TYPE_DICT)
+				{
+					// they differ, so the child patch won't be empty
+					jsl_data_dict* child = jsl_data_pool::hire_dict();
+					if(child != nullptr) stack.push_back({ (const jsl_data_dict*)f, (const jsl_data_dict*)t, child });
+					value = child;
+				}
+				else value = copy(slot);
+			}
+
+			if(value == nullptr)
+			{
+				ESP_LOGE(PATCH_LOGTAG, "Error : pool exhausted");
+				patch->fire();
+				return nullptr;
+			}
+			triple.patch->put(key->c_str(),value);
+		}
+	}
+
+	return patch;
+}
+
+jsl_data* jsl_patch::resolve(jsl_data& _root, const char* _pointer)
+{
+	path_t path;
+	if(!split(_pointer,path)) return nullptr;
+	if(path.empty()) return &_root;
+
+	// read in place down to the parent, only the node handed out is materialized
+	jsl_data_scal scratch;
+	jsl_data* parent = (jsl_data*)walk(_root,path,path.size() - 1,scratch);
+	if(parent == nullptr) return nullptr;
+	if(parent->type() == jsl_data::TYPE_DICT)
+	{
+		jsl_data_dict& dict = *(jsl_data_dict*)parent;
+		auto found = dict.find(path.back());
+		return found == dict.end() ? nullptr : found->second;
+	}
+	if(parent->type() == jsl_data::TYPE_VECT)
+	{
+		jsl_data_vect& vect = *(jsl_data_vect*)parent;
+		int32_t i;
+		return index(path.back(),vect.size(),i) && i < vect.size() ? vect[i] : nullptr;
+	}
+	return nullptr;
+}
+
+bool jsl_patch::same(const jsl_data* _a, const jsl_data* _b)
+{
+	// the cached hashes rule most pairs out, a match is never walked again.
+	// No node (nullptr) is never the same as anything, not even itself
+	if(_a == nullptr || _b == nullptr) return false;
+	if(_a == _b) return true;
+	return *_a == *_b;
+}
+
+jsl_data* jsl_patch::copy(jsl_data* _slot)
+{
+	if(_slot == nullptr) return jsl_data::imm(jsl_data::TYPE_NULL);
+	if(jsl_data::is_imm(_slot)) return _slot;
+	return jsl_data_pool::clone(*_slot);
+}
+
+bool jsl_patch::emit(jsl_data_vect& _ops, const char* _op, const std::string& _path, const jsl_data* _value)
+{
+	jsl_data_dict* op = jsl_data_pool::hire_dict();
+	jsl_data_scal* name = jsl_data_pool::hire(_op);
+	jsl_data_scal* path = jsl_data_pool::hire(_path);
+	jsl_data* value = _value != nullptr ? jsl_data_pool::clone(*_value) : nullptr;
+
+	if(op == nullptr || name == nullptr || path == nullptr || (_value != nullptr && value == nullptr))
+	{
+		if(op != nullptr) op->fire();
+		if(name != nullptr) name->fire();
+		if(path != nullptr) path->fire();
+		if(value != nullptr) value->fire();
+		return false;
+	}
+
+	op->set_prop("op",*name);
+	op->set_prop("path",*path);
+	if(value != nullptr) op->set_prop("value",*value);
+	_ops.push_back(*op);
+	return true;
+}
+
+std::string jsl_patch::escape(const std::string& _token)
+{
+	std::string token;
+	token.reserve(_token.size());
+	for(auto c = _token.begin(); c != _token.end(); ++c)
+	{
+		if(*c == '~') token += "~0";
+		else if(*c == '/') token += "~1";
+		else token += *c;
+	}
+	return token;
+}
+
+bool jsl_patch::split(const char* _pointer, path_t& _path)
+{
+	_path.clear();
+	if(_pointer == nullptr) return false;
+	if(*_pointer == '\0') return true; // whole document
+	if(*_pointer != '/') return false;
+
+	for(const char* p = _pointer; *p == '/';)
+	{
+		std::string token;
+		for(++p; *p != '\0' && *p != '/'; ++p)
+		{
+			if(*p != '~')
+			{
+				token += *p;
+				continue;
+			}
+			++p;
+			if(*p == '0') token += '~';
+			else if(*p == '1') token += '/';
+			else return false;
+		}
+		_path.push_back(std::move(token));
+	}
+	return true;
+}
+
+const jsl_data* jsl_patch::walk(const jsl_data& _root, const path_t& _path, size_t _count, jsl_data_scal& _scratch)
+{
+	const jsl_data* node = &_root;
+
+	for(size_t t = 0; t < _count && node != nullptr; ++t)
+	{
+		if(node->type() == jsl_data::TYPE_DICT)
+		{
+			const jsl_data_dict::dict_t& props = ((const jsl_data_dict*)node)->m_container;
+			auto found = props.find(_path[t]);
+			node = found == props.end() ? nullptr : jsl_data::peek(found->second,_scratch);
+		}
+		else if(node->type() == jsl_data::TYPE_VECT)
+		{
+			const jsl_data_vect& vect = *(const jsl_data_vect*)node;
+			int32_t i;
+			node = index(_path[t],vect.size(),i) && i < vect.size() ? vect.peek(i,_scratch) : nullptr;
+		}
+		else node = nullptr;
+	}
+
+	return node;
+}
+
+bool jsl_patch::index(const std::string& _token, int32_t _size, int32_t& _i)
+{
+	// "-" is the slot past the end, no leading zeros
+	if(_token == "-")
+	{
+		_i = _size;
+		return true;
+	}
+	if(_token.empty() || _token.size() > 10 || (_token[0] == '0' && _token.size() > 1)) return false;
+
+	int64_t i = 0;
+	for(auto c = _token.begin(); c != _token.end(); ++c)
+	{
+		if(*c < '0' || *c > '9') return false;
+		i = i * 10 + (*c - '0');
+	}
+	if(i > _size) return false;
+	_i = (int32_t)i;
+	return true;
+}
+
+jsl_patch::result_t jsl_patch::add(jsl_data_dict& _doc, const path_t& _path, jsl_data& _value)
+{
+	if(_path.empty())
+	{
+		// the whole document is replaced, it must stay a dict
+		if(_value.type() != jsl_data::TYPE_DICT) return PATCH_OP;
+		while(_doc.size() > 0) _doc.erase(_doc.m_container.begin()->first.c_str());
+		_doc.splice((jsl_data_dict&)_value);
+		_value.fire();
+		return PATCH_OK;
+	}
+
+	jsl_data_scal scratch; // where a scalar parent would land, it fails below
+	jsl_data* parent = (jsl_data*)walk(_doc,_path,_path.size() - 1,scratch);
+	if(parent == nullptr) return PATCH_PATH;
+
+	if(parent->type() == jsl_data::TYPE_DICT)
+	{
+		jsl_data* former = ((jsl_data_dict*)parent)->set_prop(_path.back(),_value);
+		if(former != nullptr) former->fire();
+		return PATCH_OK;
+	}
+	if(parent->type() == jsl_data::TYPE_VECT)
+	{
+		jsl_data_vect& vect = *(jsl_data_vect*)parent;
+		int32_t i;
+		if(!index(_path.back(),vect.size(),i)) return PATCH_PATH;
+		vect.insert(i,_value);
+		return PATCH_OK;
+	}
+	return PATCH_PATH;
+}
+
+jsl_patch::result_t jsl_patch::remove(jsl_data_dict& _doc, const path_t& _path, jsl_data** _taken)
+{
+	if(_path.empty()) return PATCH_PATH; // the document itself stays
+
+	jsl_data_scal scratch; // where a scalar parent would land, it fails below
+	jsl_data* parent = (jsl_data*)walk(_doc,_path,_path.size() - 1,scratch);
+	jsl_data* node = nullptr;
+
+	if(parent != nullptr && parent->type() == jsl_data::TYPE_DICT)
+	{
+		jsl_data_dict& dict = *(jsl_data_dict*)parent;
+		if(_taken == nullptr) return dict.erase(_path.back().c_str()) ? PATCH_OK : PATCH_PATH; // no node needed
+		node = dict.take(_path.back().c_str());
+	}
+	else if(parent != nullptr && parent->type() == jsl_data::TYPE_VECT)
+	{
+		jsl_data_vect& vect = *(jsl_data_vect*)parent;
+		int32_t i;
+		if(!index(_path.back(),vect.size(),i) || i >= vect.size()) return PATCH_PATH;
+		if(_taken == nullptr)
+		{
+			vect.erase(i);
+			return PATCH_OK;
+		}
+		node = vect.take(i);
+	}
+	if(node == nullptr) return PATCH_PATH;
+
+	*_taken = node;
+	return PATCH_OK;
+}
@@ -0,0 +1,98 @@
+/*
+	jsl-patch.h
+
+	This scource file is part of the jsl-esp32 project.
+
+	Author: Lorenzo Pastrana
+	Copyright © 2019 Lorenzo Pastrana
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your
+	option) any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+	for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+
+#ifndef JSL_PATCH_H
+#define JSL_PATCH_H
+
+#include <string>
+#include <vector>
+
+#include "jsl-data.h"
+
+
+
+// In place updates of a resident tree, the cost follows the patch not the document.
+// Values are cloned from the patch (which is left untouched) through the pool,
+// the nodes they replace are fired.
+//
+//	jsl_data_vect* ops = jsl_parser::parse_vect(msg);
+//	if(jsl_patch::apply(*config,*ops) != jsl_patch::PATCH_OK) { ... }
+//	ops->fire();
+
+class jsl_patch
+{
+public:
+
+	typedef enum {
+		PATCH_OK,
+		PATCH_OP, // malformed operation (unknown op, missing member)
+		PATCH_PATH, // pointer does not resolve
+		PATCH_TEST, // test operation failed
+		PATCH_POOL // not enough nodes left
+	} result_t;
+
+	static const char* what(result_t _result);
+
+	// RFC 6902 JSON Patch. Operations apply in order and the first failure stops
+	// the run, the ones before it stay applied (no copy of the document is made).
+	// _failed receives the index of the failing operation.
+	static result_t apply(jsl_data_dict& _doc, jsl_data_vect& _patch, int32_t* _failed = nullptr);
+
+	// RFC 7386 JSON Merge Patch, null members remove
+	static result_t merge(jsl_data_dict& _doc, jsl_data_dict& _patch);
+
+	// RFC 6902 patch turning _from into _to, nullptr when the pool runs out.
+	// Identical subtrees are skipped on their cached hash, vects are
+	// trimmed of their common head and tail then paired item by item. Both
+	// trees are read in place, packed vects stay packed.
+	static jsl_data_vect* diff(jsl_data_dict& _from, jsl_data_dict& _to);
+
+	// RFC 7386 merge patch turning _from into _to, nullptr when the pool runs out.
+	// Vects are sent whole when they differ, and a null member of _to can't be
+	// told apart from a removal (a limit of the format).
+	static jsl_data_dict* merge_diff(jsl_data_dict& _from, jsl_data_dict& _to);
+
+	// RFC 6901 JSON Pointer, nullptr when it does not resolve
+	static jsl_data* resolve(jsl_data& _root, const char* _pointer);
+
+protected:
+
+	typedef std::vector<std::string> path_t;
+	static bool same(const jsl_data* _a, const jsl_data* _b);
+	static jsl_data* copy(jsl_data* _slot); // same value : an immediate as it is, a node cloned (nullptr when the pool runs out)
+	static bool emit(jsl_data_vect& _ops, const char* _op, const std::string& _path, const jsl_data* _value);
+	static std::string escape(const std::string& _token);
+
+	static bool split(const char* _pointer, path_t& _path);
+	// Value at the first _count tokens, read in place : a node of the tree, or
+	// _scratch holding an immediate or a packed item. nullptr when it does not resolve
+	static const jsl_data* walk(const jsl_data& _root, const path_t& _path, size_t _count, jsl_data_scal& _scratch);
+	static bool index(const std::string& _token, int32_t _size, int32_t& _i);
+
+	static result_t add(jsl_data_dict& _doc, const path_t& _path, jsl_data& _value);
+	static result_t remove(jsl_data_dict& _doc, const path_t& _path, jsl_data** _taken);
+};
+
+#endif // #ifndef JSL_PATCH_H
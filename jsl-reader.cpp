@@ -0,0 +1,228 @@
+/*
+	jsl-reader.cpp
+
+	This scource file is part of the jsl-esp32 project.
+
+	Author: Lorenzo Pastrana
+	Copyright © 2019 Lorenzo Pastrana
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your
+	option) any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+	for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+
+#include <cstdlib>
+
+#define LOG_LOCAL_LEVEL ESP_LOG_NONE
+// #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+constexpr char READER_LOGTAG[] = "READER :";
+#include <esp_log.h>
+
+#include "jsl-reader.h"
+
+
+
+jsl_reader::token_t jsl_reader::next()
+{
+	if(m_token == TOKEN_ERROR) return m_token;
+	if(m_done) return m_token = TOKEN_END;
+
+	eat_space();
+	int c = m_src.peek();
+
+	if(!m_brackets.empty())
+	{
+		char open = m_brackets.back();
+
+		if(c == (open == '{' ? '}' : ']'))
+		{
+			m_src.get();
+			return close();
+		}
+
+		if(!m_first)
+		{
+			if(c != ',')
+			{
+				ESP_LOGE(READER_LOGTAG, "Error : unexpected char [%c]",c);
+				return fail();
+			}
+			m_src.get();
+			eat_space();
+			c = m_src.peek();
+		}
+
+		m_first = false;
+
+		if(open == '{')
+		{
+			m_key.clear();
+			if(c != '"' || scan_str(m_key))
+			{
+				ESP_LOGE(READER_LOGTAG, "Error : prop-name was not there");
+				return fail();
+			}
+			eat_space();
+			if(m_src.peek() != ':')
+			{
+				ESP_LOGE(READER_LOGTAG, "Error : prop-value was not there");
+				return fail();
+			}
+			m_src.get();
+			eat_space();
+			c = m_src.peek();
+		}
+	}
+
+	if((c == '{' || c == '[') && m_brackets.size() >= m_limits.depth)
+	{
+		ESP_LOGE(READER_LOGTAG, "Error : depth limit");
+		jsl_parser::fail(jsl_error::ERROR_LIMIT);
+		return fail();
+	}
+
+	switch(c)
+	{
+	case '{': // dict
+		m_src.get();
+		m_brackets.push_back('{');
+		m_first = true;
+		return m_token = TOKEN_DICT;
+	case '[': // vect
+		m_src.get();
+		m_brackets.push_back('[');
+		m_first = true;
+		return m_token = TOKEN_VECT;
+	case '"': // string
+		m_str.clear();
+		if(scan_str(m_str)) return fail();
+		m_token = TOKEN_STR;
+		break;
+	case 'n': // null
+		if(scan_lit("null")) return fail();
+		m_token = TOKEN_NULL;
+		break;
+	case 't': // true
+		if(scan_lit("true")) return fail();
+		m_bool = true;
+		m_token = TOKEN_BOOL;
+		break;
+	case 'f': // false
+		if(scan_lit("false")) return fail();
+		m_bool = false;
+		m_token = TOKEN_BOOL;
+		break;
+	case '0': // number
+	case '1':
+	case '2':
+	case '3':
+	case '4':
+	case '5':
+	case '6':
+	case '7':
+	case '8':
+	case '9':
+	case '-':
+		m_str.clear();
+		if(scan_num(m_str,m_intg)) return fail();
+		m_token = TOKEN_NUM;
+		break;
+	default:
+		ESP_LOGE(READER_LOGTAG, "Error : unexpected char [%c]",c);
+		return fail(); // invalid src or EOF
+	}
+
+	if(m_brackets.empty()) m_done = true; // scalar root
+	return m_token;
+}
+
+bool jsl_reader::skip()
+{
+	if(m_token != TOKEN_DICT && m_token != TOKEN_VECT) return m_token != TOKEN_ERROR;
+
+	// the opening bracket is already eaten
+	if(skip_value(m_brackets.back()))
+	{
+		fail();
+		return false;
+	}
+	close();
+	return true;
+}
+
+bool jsl_reader::find(const char* _key)
+{
+	if(m_brackets.empty() || m_brackets.back() != '{') return false;
+
+	while(true)
+	{
+		switch(next())
+		{
+		case TOKEN_ERROR:
+		case TOKEN_END:
+		case TOKEN_DICT_END:
+			return false;
+		default:
+			break;
+		}
+		if(m_key == _key) return true;
+		if(!skip()) return false;
+	}
+}
+
+bool jsl_reader::get_int(int32_t& _val) const
+{
+	if(m_token != TOKEN_NUM) return false;
+	if(m_intg) _val = std::strtol(m_str.c_str(),nullptr,10);
+	else _val = (int32_t)(std::strtod(m_str.c_str(),nullptr) + 0.5);
+	return true;
+}
+
+bool jsl_reader::get_real(double& _val) const
+{
+	if(m_token != TOKEN_NUM) return false;
+	_val = std::strtod(m_str.c_str(),nullptr);
+	return true;
+}
+
+bool jsl_reader::get_bool(bool& _val) const
+{
+	if(m_token != TOKEN_BOOL) return false;
+	_val = m_bool;
+	return true;
+}
+
+bool jsl_reader::get_str(std::string& _val) const
+{
+	if(m_token != TOKEN_STR) return false;
+	_val = m_str;
+	return true;
+}
+
+jsl_reader::token_t jsl_reader::fail()
+{
+	ESP_LOGE(READER_LOGTAG, "Error : reader aborted");
+	fail_char(); // unless the tokenizer already told why
+	return m_token = TOKEN_ERROR;
+}
+
+jsl_reader::token_t jsl_reader::close()
+{
+	m_token = (m_brackets.back() == '{') ? TOKEN_DICT_END : TOKEN_VECT_END;
+	m_brackets.pop_back();
+	m_first = false;
+	if(m_brackets.empty()) m_done = true;
+	return m_token;
+}
@@ -0,0 +1,124 @@
+/*
+	jsl-reader.h
+
+	This scource file is part of the jsl-esp32 project.
+
+	Author: Lorenzo Pastrana
+	Copyright © 2019 Lorenzo Pastrana
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your
+	option) any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+	for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+
+#ifndef JSL_READER_H
+#define JSL_READER_H
+
+#include <string>
+#include <vector>
+
+#include "jsl-parser.h"
+
+
+
+// Forward only pull reader : walks the source token by token, no node is hired.
+//
+//	jsl_reader reader(src);
+//	reader.next(); // TOKEN_DICT
+//	while(reader.next() != jsl_reader::TOKEN_DICT_END)
+//	{
+//		if(reader.key() == "id") reader.get_int(id);
+//		else reader.skip();
+//	}
+
+class jsl_reader : protected jsl_parser
+{
+public:
+
+	typedef enum {
+		TOKEN_ERROR,
+		TOKEN_END, // source exhausted
+		TOKEN_DICT,
+		TOKEN_DICT_END,
+		TOKEN_VECT,
+		TOKEN_VECT_END,
+		TOKEN_NULL,
+		TOKEN_BOOL,
+		TOKEN_NUM,
+		TOKEN_STR
+	} token_t;
+
+	jsl_reader(src_t& _src) :
+		jsl_parser(_src),
+		m_token(TOKEN_END),
+		m_first(false),
+		m_done(false),
+		m_intg(false),
+		m_bool(false)
+	{}
+
+	jsl_reader(jsl_memstream& _src) :
+		jsl_parser(_src),
+		m_token(TOKEN_END),
+		m_first(false),
+		m_done(false),
+		m_intg(false),
+		m_bool(false)
+	{}
+
+	// Steps to the next value or container boundary, stepping into containers
+	token_t next();
+
+	// Consumes the rest of the current container, or does nothing on scalars
+	bool skip();
+
+	// Steps over the current dict members until _key, false on DICT_END
+	bool find(const char* _key);
+
+	using jsl_parser::error;
+	using jsl_parser::locate;
+	using jsl_parser::limits;
+
+	inline token_t token() const { return m_token; }
+	inline int32_t depth() const { return m_brackets.size(); }
+
+	// Key of the current value when inside a dict
+	inline const std::string& key() const { return m_key; }
+
+	bool get_int(int32_t& _val) const;
+	bool get_real(double& _val) const;
+	bool get_bool(bool& _val) const;
+	bool get_str(std::string& _val) const;
+
+	inline bool is_int() const { return m_token == TOKEN_NUM && m_intg; }
+	inline const std::string& str() const { return m_str; } // raw text of the last STR or NUM
+
+protected:
+
+	token_t fail();
+	token_t close();
+
+	token_t m_token;
+	std::vector<char> m_brackets; // open brackets
+	std::string m_key;
+	std::string m_str;
+
+	bool m_first; // no member read yet in the innermost container
+	bool m_done; // root value complete
+	bool m_intg;
+	bool m_bool;
+};
+
+#endif // #ifndef JSL_READER_H
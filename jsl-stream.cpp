@@ -0,0 +1,218 @@
+/*
+	jsl-stream.cpp
+
+	This scource file is part of the jsl-esp32 project.
+
+	Author: Lorenzo Pastrana
+	Copyright © 2019 Lorenzo Pastrana
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your
+	option) any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+	for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+
+#include <fstream>
+#include <cerrno>
+#include <unistd.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define JSL_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define LOG_LOCAL_LEVEL ESP_LOG_NONE
+// #define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+constexpr char STREAM_LOGTAG[] = "STREAM :";
+#include <esp_log.h>
+
+#include "jsl-stream.h"
+
+
+
+jsl_sinkbuf::jsl_sinkbuf(const sink_t& _sink, size_t _size) :
+	m_sink(_sink),
+	m_buf(new char[_size > 0 ? _size : 1]),
+	m_size(_size > 0 ? _size : 1)
+{
+	setp(m_buf, m_buf + m_size);
+}
+
+jsl_sinkbuf::~jsl_sinkbuf()
+{
+	flush();
+	delete[] m_buf;
+}
+
+bool jsl_sinkbuf::flush()
+{
+	size_t size = pptr() - pbase();
+	setp(m_buf, m_buf + m_size);
+	if(size == 0) return true;
+	if(!m_sink || !m_sink(m_buf,size))
+	{
+		ESP_LOGE(STREAM_LOGTAG, "Error : sink fail");
+		return false;
+	}
+	return true;
+}
+
+jsl_sinkbuf::int_type jsl_sinkbuf::overflow(int_type _c)
+{
+	if(!flush()) return traits_type::eof();
+	if(!traits_type::eq_int_type(_c,traits_type::eof()))
+	{
+		*pptr() = traits_type::to_char_type(_c);
+		pbump(1);
+	}
+	return traits_type::not_eof(_c);
+}
+
+std::streamsize jsl_sinkbuf::xsputn(const char* _s, std::streamsize _n)
+{
+	size_t room = epptr() - pptr();
+	if((size_t)_n <= room)
+	{
+		traits_type::copy(pptr(),_s,_n);
+		pbump(_n);
+		return _n;
+	}
+
+	// does not fit : flush and hand big blocks straight to the sink
+	if(!flush()) return 0;
+	if((size_t)_n >= m_size)
+	{
+		return m_sink(_s,_n) ? _n : 0;
+	}
+	traits_type::copy(pptr(),_s,_n);
+	pbump(_n);
+	return _n;
+}
+
+int jsl_sinkbuf::sync()
+{
+	return flush() ? 0 : -1;
+}
+
+jsl_sinkbuf::sink_t jsl_sinkbuf::fd_sink(int _fd)
+{
+	return [_fd](const char* _data, size_t _size)
+	{
+		while(_size > 0)
+		{
+			ssize_t done = ::write(_fd,_data,_size);
+			if(done < 0)
+			{
+				if(errno == EINTR) continue;
+				return false;
+			}
+			_data += done;
+			_size -= done;
+		}
+		return true;
+	};
+}
+
+jsl_sinkbuf::sink_t jsl_sinkbuf::file_sink(FILE* _file)
+{
+	return [_file](const char* _data, size_t _size)
+	{
+		return std::fwrite(_data,1,_size,_file) == _size;
+	};
+}
+
+
+
+bool jsl_filemap::open(const char* _path)
+{
+	close();
+
+#ifdef JSL_HAS_MMAP
+
+	int fd = ::open(_path,O_RDONLY);
+	if(fd < 0)
+	{
+		ESP_LOGE(STREAM_LOGTAG, "Failed to open [%s] for reading",_path);
+		return false;
+	}
+
+	struct stat st;
+	if(::fstat(fd,&st) != 0)
+	{
+		ESP_LOGE(STREAM_LOGTAG, "Failed to stat [%s]",_path);
+		::close(fd);
+		return false;
+	}
+
+	if(st.st_size == 0)
+	{
+		::close(fd);
+		return true; // empty file, nothing to map
+	}
+
+	void* map = ::mmap(nullptr,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	::close(fd); // the mapping keeps its own reference
+
+	if(map != MAP_FAILED)
+	{
+		::madvise(map,st.st_size,MADV_SEQUENTIAL);
+		m_data = (const char*)map;
+		m_size = st.st_size;
+		m_mapped = true;
+		return true;
+	}
+
+	ESP_LOGW(STREAM_LOGTAG, "Failed to map [%s], reading it",_path);
+
+#endif // #ifdef JSL_HAS_MMAP
+
+	std::ifstream file(_path, std::ios::binary | std::ios::ate);
+	if(!file.is_open())
+	{
+		ESP_LOGE(STREAM_LOGTAG, "Failed to open [%s] for reading",_path);
+		return false;
+	}
+
+	size_t size = file.tellg();
+	char* data = new char[size];
+	file.seekg(0);
+	if(!file.read(data,size))
+	{
+		ESP_LOGE(STREAM_LOGTAG, "Failed to read [%s]",_path);
+		delete[] data;
+		return false;
+	}
+
+	m_data = data;
+	m_size = size;
+	return true;
+}
+
+void jsl_filemap::close()
+{
+	if(m_data != nullptr)
+	{
+#ifdef JSL_HAS_MMAP
+		if(m_mapped) ::munmap(const_cast<char*>(m_data),m_size);
+		else
+#endif
+		delete[] m_data;
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_mapped = false;
+}
@@ -0,0 +1,217 @@
+/*
+	jsl-stream.h
+
+	This scource file is part of the jsl-esp32 project.
+
+	Author: Lorenzo Pastrana
+	Copyright © 2019 Lorenzo Pastrana
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your
+	option) any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+	for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+
+#ifndef JSL_STREAM_H
+#define JSL_STREAM_H
+
+#include <cstddef>
+#include <cstdio>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <streambuf>
+#include <functional>
+
+
+
+// Read only stream buffer over a contiguous memory range (no copy)
+
+class jsl_membuf : public std::streambuf
+{
+public:
+
+	jsl_membuf(const char* _buf, size_t _len)
+	{
+		char* buf = const_cast<char*>(_buf);
+		setg(buf, buf, buf + _len);
+	}
+
+	inline const char* begin() const { return eback(); }
+	inline const char* cur() const { return gptr(); }
+	inline const char* end() const { return egptr(); }
+
+	inline void seek(const char* _pos) { setg(eback(), const_cast<char*>(_pos), egptr()); }
+
+	inline void reset(const char* _buf, size_t _len)
+	{
+		char* buf = const_cast<char*>(_buf);
+		setg(buf, buf, buf + _len);
+	}
+
+protected:
+
+	virtual pos_type seekoff(off_type _off, std::ios_base::seekdir _dir, std::ios_base::openmode /* _which */ = std::ios_base::in)
+	{
+		const char* pos = nullptr;
+		switch(_dir)
+		{
+		case std::ios_base::beg:
+			pos = eback() + _off;
+			break;
+		case std::ios_base::cur:
+			pos = gptr() + _off;
+			break;
+		case std::ios_base::end:
+			pos = egptr() + _off;
+			break;
+		default:
+			return pos_type(off_type(-1));
+		}
+		if(pos < eback() || pos > egptr()) return pos_type(off_type(-1));
+		setg(eback(), const_cast<char*>(pos), egptr());
+		return pos_type(off_type(pos - eback()));
+	}
+
+	virtual pos_type seekpos(pos_type _pos, std::ios_base::openmode _which = std::ios_base::in)
+	{
+		return seekoff(off_type(_pos), std::ios_base::beg, _which);
+	}
+};
+
+
+
+// Input stream owning a jsl_membuf, feeds jsl_parser straight from memory
+
+class jsl_memstream : public std::istream
+{
+public:
+
+	jsl_memstream(const char* _buf, size_t _len) :
+		std::istream(nullptr),
+		m_buf(_buf,_len)
+	{
+		rdbuf(&m_buf);
+	}
+
+	jsl_memstream(const std::string& _str) :
+		jsl_memstream(_str.data(),_str.size())
+	{
+	}
+
+	inline jsl_membuf& buf() { return m_buf; }
+
+	// Points the stream at a new range, a parser built on it can be kept
+	void reset(const char* _buf, size_t _len)
+	{
+		m_buf.reset(_buf,_len);
+		clear();
+	}
+
+protected:
+
+	jsl_membuf m_buf;
+};
+
+
+
+// Write only stream buffer of fixed size, flushed to a sink whenever full
+// (and on sync), so encoding a tree of any size uses constant memory
+
+class jsl_sinkbuf : public std::streambuf
+{
+public:
+
+	// Returns false when the data could not be delivered
+	typedef std::function<bool(const char* _data, size_t _size)> sink_t;
+
+	jsl_sinkbuf(const sink_t& _sink, size_t _size = 512);
+	virtual ~jsl_sinkbuf();
+
+	static sink_t fd_sink(int _fd); // POSIX fd or socket
+	static sink_t file_sink(FILE* _file);
+
+protected:
+
+	jsl_sinkbuf(const jsl_sinkbuf&) = delete;
+	jsl_sinkbuf& operator= (const jsl_sinkbuf&) = delete;
+
+	bool flush();
+
+	virtual int_type overflow(int_type _c);
+	virtual std::streamsize xsputn(const char* _s, std::streamsize _n);
+	virtual int sync();
+
+	sink_t m_sink;
+	char* m_buf;
+	size_t m_size;
+};
+
+
+
+// Output stream owning a jsl_sinkbuf, hand it to jsl_data::encode
+
+class jsl_sinkstream : public std::ostream
+{
+public:
+
+	jsl_sinkstream(const jsl_sinkbuf::sink_t& _sink, size_t _size = 512) :
+		std::ostream(nullptr),
+		m_buf(_sink,_size)
+	{
+		rdbuf(&m_buf);
+	}
+
+	virtual ~jsl_sinkstream() { flush(); }
+
+protected:
+
+	jsl_sinkbuf m_buf;
+};
+
+
+
+// Read only view of a whole file, memory mapped when the platform allows it,
+// read into a single heap buffer otherwise (e.g. esp32 VFS has no mmap)
+
+class jsl_filemap
+{
+public:
+
+	jsl_filemap() :
+		m_data(nullptr),
+		m_size(0),
+		m_mapped(false)
+	{}
+
+	~jsl_filemap() { close(); }
+
+	bool open(const char* _path);
+	void close();
+
+	inline const char* data() const { return m_data; }
+	inline size_t size() const { return m_size; }
+	inline bool mapped() const { return m_mapped; }
+
+protected:
+
+	jsl_filemap(const jsl_filemap&) = delete;
+	jsl_filemap& operator= (const jsl_filemap&) = delete;
+
+	const char* m_data;
+	size_t m_size;
+	bool m_mapped;
+};
+
+#endif // #ifndef JSL_STREAM_H
@@ -24,58 +24,220 @@
 
 
 
+#include <iostream>
+#include <sstream>
+
 #include "../jsl-parser.h"
+#include "../jsl-reader.h"
+#include "../jsl-patch.h"
+#include "../jsl-image.h"
+#include "../jsl-literal.h"
 
 #define PARSER_TEST_LOGTAG "PARSER-TEST :"
 #include <esp_log.h>
 
-bool load_file(const char* _fname, std::ostringstream& _dest)
+void test_parser()
 {
-	std::ifstream file(_fname, std::ios::binary);
-	if(file.is_open())
+	ESP_LOGI(PARSER_TEST_LOGTAG, "Test PARSER");
+
+	jsl_data_pool::init(100,20,20);
+
+	jsl_error error;
+	jsl_data_dict* data = jsl_parser::parse_file("/test.json",&error);
+	if(data != nullptr)
 	{
-		ESP_LOGI(PARSER_TEST_LOGTAG, "File open [%s]",_fname);
+		ESP_LOGI(PARSER_TEST_LOGTAG, "Data file parsed");
+		data->encode(std::cout,true);
+		std::cout << "\n";
+		data->fire();
+	}
+	else ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to parse file : %s at %u:%u",error.what(),error.line,error.col);
+
+	jsl_data_pool::init(0,0,0);
+}
 
-		_dest << file.rdbuf();
-		file.close();
+void test_reader()
+{
+	ESP_LOGI(PARSER_TEST_LOGTAG, "Test READER");
+
+	jsl_filemap file;
+	if(!file.open("/test.json")) return;
 
-		return true;
+	jsl_memstream src(file.data(),file.size());
+	jsl_reader reader(src);
+
+	if(reader.next() != jsl_reader::TOKEN_DICT || !reader.find("object") || reader.token() != jsl_reader::TOKEN_DICT)
+	{
+		ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to reach [object]");
+		return;
 	}
 
-	ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to open [%s] for reading",_fname);
+	int32_t uint = 0;
+	if(reader.find("number_uint") && reader.get_int(uint))
+	{
+		ESP_LOGI(PARSER_TEST_LOGTAG, "number_uint : %d",uint);
+	}
+	else ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to read [number_uint]");
+}
+
+void test_clone()
+{
+	ESP_LOGI(PARSER_TEST_LOGTAG, "Test CLONE");
+
+	jsl_data_pool::init(100,20,20);
+
+	jsl_data_dict* data = jsl_parser::parse_file("/test.json");
+	if(data == nullptr) return;
 
-	return false;
+	jsl_data_dict* copy = jsl_data_pool::clone(*data);
+	if(copy == nullptr)
+	{
+		ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to clone");
+		data->fire();
+		return;
+	}
+
+	if(*copy != *data) ESP_LOGE(PARSER_TEST_LOGTAG, "Clone differs from its source");
+
+	// held in the slots, no node hired
+	int32_t count = 0;
+	copy->set_bool("flag",true);
+	if(!copy->set_int("count",3) || !copy->get("count",count) || count != 3) ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to set [count]");
+
+	jsl_data_dict* state = jsl_data_pool::hire_dict();
+	if(copy->move("object",*state,"moved"))
+	{
+		state->encode(std::cout,true);
+		std::cout << "\n";
+	}
+	else ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to move [object]");
+
+	state->fire();
+	copy->fire();
+	data->fire();
+
+	jsl_data_pool::init(0,0,0);
 }
 
-bool load_file(const char* _fname, std::string& _dest)
+void test_reparse()
 {
-	std::ostringstream buf;
+	ESP_LOGI(PARSER_TEST_LOGTAG, "Test REPARSE");
+
+	jsl_data_pool::init(100,20,20);
+
+	const std::string msgs[] = {
+		"{\"seq\":1,\"temp\":21.5,\"unit\":\"celsius\",\"log\":[1,2,3]}",
+		"{\"seq\":2,\"temp\":21.75,\"unit\":\"celsius\",\"log\":[2,3,4]}",
+		"{\"seq\":3,\"temp\":\"n/a\",\"log\":[]}"
+	};
+
+	jsl_memstream src(msgs[0]);
+	jsl_parser parser(src);
+	jsl_data_dict* data = parser.parse();
+	if(data == nullptr) return;
 
-	if(!load_file(_fname,buf)) return false;
+	for(const std::string& msg : msgs)
+	{
+		src.reset(msg.data(),msg.size());
+		if(!parser.reparse(*data))
+		{
+			ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to reparse : %s",parser.error().what());
+			break;
+		}
+		data->encode(std::cout);
+		std::cout << "\n";
+	}
 
-	_dest = buf.str();
-	return true;
+	data->fire();
+
+	jsl_data_pool::init(0,0,0);
 }
 
-void test_parser()
+void test_patch()
 {
-	ESP_LOGI(PARSER_TEST_LOGTAG, "Test PARSER");
+	ESP_LOGI(PARSER_TEST_LOGTAG, "Test PATCH");
 
 	jsl_data_pool::init(100,20,20);
 
-	std::string test;
+	jsl_data_dict* data = jsl_parser::parse_file("/test.json");
+	jsl_data_vect* ops = jsl_parser::parse_vect(std::string(
+		"[{\"op\":\"replace\",\"path\":\"/object/true\",\"value\":false},"
+		"{\"op\":\"remove\",\"path\":\"/array/0\"}]"
+	));
 
-	if(!load_file("/test.json",test)) return;
+	if(data != nullptr && ops != nullptr)
+	{
+		int32_t failed;
+		jsl_patch::result_t result = jsl_patch::apply(*data,*ops,&failed);
+		if(result == jsl_patch::PATCH_OK)
+		{
+			data->encode(std::cout,true);
+			std::cout << "\n";
+		}
+		else ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to patch : %s at op %d",jsl_patch::what(result),failed);
+	}
 
-	jsl_parser parser(test);
-	jsl_data_dict* data = parser.parse();
-	if(data != nullptr)
+	// a move to nowhere fails and leaves the document as it was
+	jsl_data_vect* lost = jsl_parser::parse_vect(std::string(
+		"[{\"op\":\"move\",\"from\":\"/array/0\",\"path\":\"/array/99\"}]"
+	));
+	if(data != nullptr && lost != nullptr)
 	{
-		ESP_LOGI(PARSER_TEST_LOGTAG, "Data file parsed");
-		std::cout << data->encode(true) << "\n\n";
-		data->fire();
+		std::ostringstream before, after;
+		data->encode(before);
+		int32_t failed;
+		jsl_patch::result_t result = jsl_patch::apply(*data,*lost,&failed);
+		data->encode(after);
+		if(result != jsl_patch::PATCH_PATH || before.str() != after.str()) ESP_LOGE(PARSER_TEST_LOGTAG, "Failed move : %s",after.str().c_str());
 	}
-	else ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to parse file");
+	if(lost != nullptr) lost->fire();
+
+	if(ops != nullptr) ops->fire();
+	if(data != nullptr) data->fire();
 
 	jsl_data_pool::init(0,0,0);
 }
+
+void test_image()
+{
+	ESP_LOGI(PARSER_TEST_LOGTAG, "Test IMAGE");
+
+	jsl_data_pool::init(100,20,20);
+
+	std::string image;
+	jsl_data_dict* data = jsl_parser::parse_file("/test.json");
+	if(data == nullptr || !jsl_image::build(*data,image))
+	{
+		ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to build the image");
+		if(data != nullptr) data->fire();
+		jsl_data_pool::init(0,0,0);
+		return;
+	}
+	data->fire();
+	jsl_data_pool::init(0,0,0); // the view needs no pool
+
+	jsl_view root = jsl_image::open(image.data(),image.size());
+	int32_t uint = 0;
+	if(root["object"].get("number_uint",uint)) ESP_LOGI(PARSER_TEST_LOGTAG, "number_uint : %d",uint);
+	else ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to read the image");
+	root.encode(std::cout);
+	std::cout << "\n";
+}
+
+void test_literal()
+{
+	ESP_LOGI(PARSER_TEST_LOGTAG, "Test LITERAL");
+
+	// compiled with the firmware, nothing to parse nor to hire
+	static const jsl_view defaults = JSL_LITERAL(R"({
+		"net": { "host": "esp32", "port": 8080 },
+		"levels": [0.5, 1, 2.5]
+	})");
+
+	int32_t port = 0;
+	double level = 0;
+	if(defaults["net"].get("port",port) && defaults["levels"].get(1,level)) ESP_LOGI(PARSER_TEST_LOGTAG, "port : %d level : %f",port,level);
+	else ESP_LOGE(PARSER_TEST_LOGTAG, "Failed to read the literal");
+	defaults.encode(std::cout);
+	std::cout << "\n";
+}
@@ -0,0 +1,120 @@
+/*
+	jsl-mkimage.cpp
+
+	This scource file is part of the jsl-esp32 project.
+
+	Author: Lorenzo Pastrana
+	Copyright © 2019 Lorenzo Pastrana
+
+	This program is free software: you can redistribute it and/or modify it
+	under the terms of the GNU General Public License as published by the
+	Free Software Foundation, either version 3 of the License, or (at your
+	option) any later version.
+
+	This program is distributed in the hope that it will be useful, but
+	WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+	or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+	for more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program. If not, see http://www.gnu.org/licenses/.
+
+*/
+
+
+
+// Host tool, compiles a json document into a jsl_image for the firmware to
+// embed or flash :
+//
+//	jsl-mkimage config.json config.jsli
+//
+// Built with the component sources on the host (an esp_log.h is needed, the
+// ESP-IDF linux target has one) :
+//
+//	g++ -std=c++17 -O2 -I. tools/jsl-mkimage.cpp jsl-*.cpp -o jsl-mkimage -lpthread
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#include "jsl-parser.h"
+#include "jsl-reader.h"
+#include "jsl-image.h"
+
+
+
+int main(int _argc, char** _argv)
+{
+	if(_argc != 3)
+	{
+		std::fprintf(stderr,"usage : %s <in.json> <out.jsli>\n",_argv[0]);
+		return 2;
+	}
+
+	jsl_filemap file;
+	if(!file.open(_argv[1]))
+	{
+		std::fprintf(stderr,"%s : can't read\n",_argv[1]);
+		return 1;
+	}
+
+	// a first pass sizes the pool (no nodes taken), and tells the root type
+
+	uint32_t scals = 0, dicts = 0, vects = 0;
+	bool vect_root = false;
+	jsl_memstream src(file.data(),file.size());
+	{
+		jsl_reader reader(src);
+		jsl_reader::token_t token;
+		while((token = reader.next()) != jsl_reader::TOKEN_END && token != jsl_reader::TOKEN_ERROR)
+		{
+			if(token == jsl_reader::TOKEN_DICT || token == jsl_reader::TOKEN_VECT)
+			{
+				if(dicts + vects == 0) vect_root = token == jsl_reader::TOKEN_VECT;
+				++(token == jsl_reader::TOKEN_DICT ? dicts : vects);
+			}
+			else if(token != jsl_reader::TOKEN_DICT_END && token != jsl_reader::TOKEN_VECT_END) ++scals;
+		}
+	}
+	jsl_data_pool::init(std::min<uint32_t>(scals + 1,UINT16_MAX),std::min<uint32_t>(dicts + 1,UINT16_MAX),std::min<uint32_t>(vects + 1,UINT16_MAX));
+
+	jsl_error error;
+	jsl_data* root;
+	if(vect_root)
+	{
+		root = jsl_parser::parse_vect(file.data(),file.size(),1,&error);
+	}
+	else
+	{
+		src.reset(file.data(),file.size());
+		jsl_parser parser(src);
+		root = parser.parse();
+		if(root == nullptr) error = parser.locate();
+	}
+	if(root == nullptr)
+	{
+		if(error.line == 0) error.locate(file.data(),file.size());
+		std::fprintf(stderr,"%s:%u:%u : %s\n",_argv[1],error.line,error.col,error.what());
+		jsl_data_pool::init(0,0,0);
+		return 1;
+	}
+
+	std::string image;
+	const bool built = jsl_image::build(*root,image);
+	root->fire();
+	jsl_data_pool::init(0,0,0);
+	if(!built)
+	{
+		std::fprintf(stderr,"%s : too large for an image\n",_argv[1]);
+		return 1;
+	}
+
+	FILE* out = std::fopen(_argv[2],"wb");
+	if(out == nullptr || std::fwrite(image.data(),1,image.size(),out) != image.size() || std::fclose(out) != 0)
+	{
+		std::fprintf(stderr,"%s : can't write\n",_argv[2]);
+		return 1;
+	}
+	std::printf("%s : %zu bytes\n",_argv[2],image.size());
+	return 0;
+}